@@ -0,0 +1,150 @@
+#include <LiteMath.h>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "constants.h"
+#include "body.h"
+#include "tape.h"
+#include "analytic.h"
+
+using namespace LiteMath;
+
+namespace Analytic {
+    static Body::Bounds bounds(const Primitive &primitive) {
+        return { .lower = primitive.position - primitive.size, .upper = primitive.position + primitive.size };
+    }
+
+    // Largest primitives first, they span the most rays
+    static float extent(const Primitive &primitive) {
+        return length(primitive.size);
+    }
+
+    static bool convert(Body::Base *body, Primitive &primitive) {
+        if (body->type == Body::Type::SPHERE) {
+            Body::Sphere *obj = static_cast<Body::Sphere*>(body);
+            primitive = { .type = body->type, .position = obj->position,
+                          .size = float3(obj->radius), .color = obj->color };
+            return true;
+        }
+        if (body->type == Body::Type::BOX) {
+            Body::Box *obj = static_cast<Body::Box*>(body);
+            primitive = { .type = body->type, .position = obj->position,
+                          .size = obj->size / 2, .color = obj->color };
+            return true;
+        }
+        return false;
+    }
+
+    // Plain spheres and boxes leave the list, only the largest ones when there are too many
+    void Set::build(Body::List *list) {
+        std::vector<std::pair<Primitive, Body::Base*>> candidates;
+        for (Body::Base *body : list->bodies) {
+            Primitive primitive;
+            if (convert(body, primitive)) candidates.push_back({ primitive, body });
+        }
+        if (candidates.empty()) return;
+
+        std::stable_sort(candidates.begin(), candidates.end(),
+            [](const std::pair<Primitive, Body::Base*> &lhs, const std::pair<Primitive, Body::Base*> &rhs) {
+                return extent(lhs.first) > extent(rhs.first);
+            });
+        if (candidates.size() > constants::analytic::limit)
+            candidates.resize(constants::analytic::limit);
+
+        for (const std::pair<Primitive, Body::Base*> &candidate : candidates) {
+            this->primitives.push_back(candidate.first);
+            list->bodies.erase(std::find(list->bodies.begin(), list->bodies.end(), candidate.second));
+        }
+        this->active = true;
+    }
+
+    Body::Bounds Set::bounds() const {
+        Body::Bounds result = Body::Bounds::empty();
+        for (const Primitive &primitive : this->primitives)
+            result = Body::Bounds::merge(result, Analytic::bounds(primitive));
+        return result;
+    }
+
+    // Entry distance of the ray into the primitive, near when the ray starts inside and infinity on a miss
+    static float enter(const Primitive &primitive, float3 origin, float3 ray, float near) {
+        float infinity = std::numeric_limits<float>::infinity();
+        float3 offset = origin - primitive.position;
+        if (primitive.type == Body::Type::SPHERE) {
+            float radius = primitive.size.x;
+            float half = dot(offset, ray);
+            float discriminant = half * half - (dot(offset, offset) - radius * radius);
+            if (discriminant < 0.0f) return infinity;
+            float root = std::sqrt(discriminant);
+            float exit = -half + root;
+            if (exit < near) return infinity;
+            return std::max(-half - root, near);
+        }
+
+        // Box distance is the largest axis distance, its surface is the box itself
+        float3 inverse = float3(1.0f) / ray;
+        float3 lower = (-primitive.size - offset) * inverse;
+        float3 upper = (primitive.size - offset) * inverse;
+        float3 entries = min(lower, upper);
+        float3 exits = max(lower, upper);
+        float entry = std::max(std::max(entries.x, entries.y), std::max(entries.z, near));
+        float exit = std::min(std::min(exits.x, exits.y), exits.z);
+        if (entry > exit) return infinity;
+        return entry;
+    }
+
+    // Closest hit inside [near, far], infinity when every primitive is missed
+    float Set::intersect(float3 origin, float3 ray, float near, float far, size_t &index) const {
+        float closest = std::numeric_limits<float>::infinity();
+        for (size_t idx = 0; idx < this->primitives.size(); idx++) {
+            float hit = enter(this->primitives[idx], origin, ray, near);
+            if (hit <= far && hit < closest) {
+                closest = hit;
+                index = idx;
+            }
+        }
+        return closest;
+    }
+
+    static float distance(const Primitive &primitive, float3 position, float3 &grad) {
+        float3 local = position - primitive.position;
+        if (primitive.type == Body::Type::SPHERE) {
+            float distance = length(local);
+            grad = distance > 0.0f ? local / distance : float3(0.0f, 1.0f, 0.0f);
+            return distance - primitive.size.x;
+        }
+
+        float3 distances = abs(local) - primitive.size;
+        int axis = 0;
+        if (distances.y > distances[axis]) axis = 1;
+        if (distances.z > distances[axis]) axis = 2;
+        grad = float3(0.0f);
+        grad[axis] = local[axis] < 0.0f ? -1.0f : 1.0f;
+        return distances[axis];
+    }
+
+    Body::Surface Set::SDF(float3 position) const {
+        Body::Surface surface = { .SD = std::numeric_limits<float>::infinity(), .color = float3(0.0f) };
+        float3 grad;
+        for (const Primitive &primitive : this->primitives) {
+            float distance = Analytic::distance(primitive, position, grad);
+            if (distance < surface.SD) surface = { .SD = distance, .color = primitive.color };
+        }
+        return surface;
+    }
+
+    float Set::distance(float3 position) const {
+        return this->SDF(position).SD;
+    }
+
+    Tape::Dual Set::gradient(float3 position) const {
+        Tape::Dual dual = { .SD = std::numeric_limits<float>::infinity(), .grad = float3(0.0f) };
+        float3 grad;
+        for (const Primitive &primitive : this->primitives) {
+            float distance = Analytic::distance(primitive, position, grad);
+            if (distance < dual.SD) dual = { .SD = distance, .grad = grad };
+        }
+        return dual;
+    }
+}
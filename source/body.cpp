@@ -1,7 +1,13 @@
 #include <LiteMath.h>
+#include <cmath>
+#include <algorithm>
 #include <limits>
 #include <iostream>
+#include <map>
 
+#include "constants.h"
+#include "simd.h"
+#include "stats.h"
 #include "object.h"
 #include "body.h"
 
@@ -17,7 +23,69 @@ namespace Body {
         return { .SD = -surface.SD, .color = surface.color };
     }
 
+    /// Bounds ///
+    // Max-norm distance to the box, no primitive SDF inside is smaller
+    float Bounds::SDF(float3 position) const {
+        float3 distances = max(this->lower - position, position - this->upper);
+        return max(max(distances.x, distances.y), distances.z);
+    }
+
+    Bounds Bounds::empty() {
+        float infinity = std::numeric_limits<float>::infinity();
+        return { .lower = float3(infinity), .upper = float3(-infinity) };
+    }
+
+    Bounds Bounds::infinite() {
+        float infinity = std::numeric_limits<float>::infinity();
+        return { .lower = float3(-infinity), .upper = float3(infinity) };
+    }
+
+    Bounds Bounds::merge(const Bounds &lbounds, const Bounds &rbounds) {
+        return { .lower = min(lbounds.lower, rbounds.lower), .upper = max(lbounds.upper, rbounds.upper) };
+    }
+
+    Bounds Bounds::intersect(const Bounds &lbounds, const Bounds &rbounds) {
+        return { .lower = max(lbounds.lower, rbounds.lower), .upper = min(lbounds.upper, rbounds.upper) };
+    }
+
+    // Narrow the ray span [near, far] to the part inside the box, false when nothing is left
+    bool Bounds::clip(float3 origin, float3 ray, float &near, float &far) const {
+        float3 inverse = float3(1.0f) / ray;
+        float3 lower = (this->lower - origin) * inverse;
+        float3 upper = (this->upper - origin) * inverse;
+        float3 enter = min(lower, upper);
+        float3 leave = max(lower, upper);
+        near = std::max(near, std::max(std::max(enter.x, enter.y), enter.z));
+        far = std::min(far, std::min(std::min(leave.x, leave.y), leave.z));
+        return near <= far;
+    }
+
     /// Base ///
+    bool composite(Type type) {
+        return type == Type::LIST || type == Type::REPEAT || type == Type::MIRROR;
+    }
+
+    /// Lipschitz bounds ///
+    // Max-norm bodies change at most by the largest ray component per unit of distance
+    static float axial(float3 ray) {
+        float3 components = abs(ray);
+        return max(max(components.x, components.y), components.z);
+    }
+
+    static float rate(float along, float side) {
+        float distance = std::sqrt(along * along + side);
+        return distance > 0.0f ? std::abs(along) / distance : 1.0f;
+    }
+
+    // Distance to the center changes by the ray component towards it, which only grows along the ray
+    static float radial(float3 origin, float3 ray, float3 center, float length) {
+        if (std::isinf(length)) return 1.0f;
+        float3 offset = origin - center;
+        float along = dot(offset, ray);
+        float side = std::max(dot(offset, offset) - along * along, 0.0f);
+        return std::max(rate(along, side), rate(along + length, side));
+    }
+
     Base::Base(Type type) : Object::Base(Object::Type::BODY), type(type) {}
 
     Surface Base::SDF(float3 position) {
@@ -25,6 +93,15 @@ namespace Body {
         return { .SD = distance, .color = float3(0.0f) };
     }
 
+    Bounds Base::bounds() {
+        return Bounds::empty();
+    }
+
+    // Every SDF of the scene changes at most by the distance traveled
+    float Base::lipschitz(float3 origin, float3 ray, float length) {
+        return 1.0f;
+    }
+
     /// Sphere ///
     Sphere::Sphere(float3 position, float radius, float3 color) :
         Base(Type::SPHERE), position(position), radius(radius), color(color) {}
@@ -34,6 +111,14 @@ namespace Body {
         return { .SD = distance, .color = this->color };
     }
 
+    Bounds Sphere::bounds() {
+        return { .lower = this->position - this->radius, .upper = this->position + this->radius };
+    }
+
+    float Sphere::lipschitz(float3 origin, float3 ray, float length) {
+        return radial(origin, ray, this->position, length);
+    }
+
     /// Box ///
     Box::Box(float3 position, float3 size, float3 color) :
         Base(Type::BOX), position(position), size(size), color(color) {}
@@ -44,6 +129,14 @@ namespace Body {
         return { .SD = distance, .color = this->color };
     }
 
+    Bounds Box::bounds() {
+        return { .lower = this->position - this->size / 2, .upper = this->position + this->size / 2 };
+    }
+
+    float Box::lipschitz(float3 origin, float3 ray, float length) {
+        return axial(ray);
+    }
+
     /// Cross ///
     Cross::Cross(float3 position, float3 size, float3 color) :
         Base(Type::CROSS), position(position), size(size), color(color) {}
@@ -56,60 +149,581 @@ namespace Body {
         return { .SD = distance, .color = this->color };
     }
 
+    // Cross bars are infinite
+    Bounds Cross::bounds() {
+        return Bounds::infinite();
+    }
+
+    float Cross::lipschitz(float3 origin, float3 ray, float length) {
+        return axial(ray);
+    }
+
+    /// Menger ///
+    Menger::Menger(float3 position, float size, int iterations, float3 color) :
+        Base(Type::MENGER), position(position), size(size), iterations(iterations), color(color) {}
+
+    // Every level subtracts an infinite Cross repeated over cells of the level size
+    Surface Menger::SDF(float3 position) {
+        float3 local = position - this->position;
+        float3 distances = abs(local) - this->size / 2;
+        float distance = max(max(distances.x, distances.y), distances.z);
+
+        float cell = this->size;
+        for (int level = 0; level < this->iterations; level++) {
+            float3 folded = local - cell * float3(
+                std::floor(local.x / cell + 0.5f),
+                std::floor(local.y / cell + 0.5f),
+                std::floor(local.z / cell + 0.5f));
+            float3 holes = abs(folded) - cell / 6;
+            float dmin = min(min(holes.x, holes.y), holes.z);
+            float dmax = max(max(holes.x, holes.y), holes.z);
+            float cross = holes.x + holes.y + holes.z - dmin - dmax;
+            distance = max(distance, -cross);
+            cell /= 3;
+        }
+
+        return { .SD = distance, .color = this->color };
+    }
+
+    Bounds Menger::bounds() {
+        return { .lower = this->position - this->size / 2, .upper = this->position + this->size / 2 };
+    }
+
+    // Folding only translates and flips axes, every level stays a max-norm body
+    float Menger::lipschitz(float3 origin, float3 ray, float length) {
+        return axial(ray);
+    }
+
+    /// Pool ///
+    Pool::Pool(Type type) : type(type), count(0) {}
+
+    void Pool::append(Base *body) {
+        switch (body->type) {
+            case Type::SPHERE:
+            {
+                Sphere *obj = static_cast<Sphere*>(body);
+                this->x.push_back(obj->position.x);
+                this->y.push_back(obj->position.y);
+                this->z.push_back(obj->position.z);
+                this->radius.push_back(obj->radius);
+                this->colors.push_back(obj->color);
+                break;
+            }
+
+            case Type::BOX:
+            {
+                Box *obj = static_cast<Box*>(body);
+                this->x.push_back(obj->position.x);
+                this->y.push_back(obj->position.y);
+                this->z.push_back(obj->position.z);
+                this->sx.push_back(obj->size.x / 2);
+                this->sy.push_back(obj->size.y / 2);
+                this->sz.push_back(obj->size.z / 2);
+                this->colors.push_back(obj->color);
+                break;
+            }
+
+            case Type::CROSS:
+            {
+                Cross *obj = static_cast<Cross*>(body);
+                this->x.push_back(obj->position.x);
+                this->y.push_back(obj->position.y);
+                this->z.push_back(obj->position.z);
+                this->sx.push_back(obj->size.x / 2);
+                this->sy.push_back(obj->size.y / 2);
+                this->sz.push_back(obj->size.z / 2);
+                this->colors.push_back(obj->color);
+                break;
+            }
+
+            default: return;
+        }
+        this->count++;
+    }
+
+    // Repeat the last body up to a whole number of lanes, duplicates never change min or max
+    template <typename T>
+    static void padArray(std::vector<T> &array) {
+        if (array.empty()) return;
+        while (array.size() % simd::lanes != 0)
+            array.push_back(array.back());
+    }
+
+    void Pool::pad() {
+        padArray(this->x);
+        padArray(this->y);
+        padArray(this->z);
+        padArray(this->sx);
+        padArray(this->sy);
+        padArray(this->sz);
+        padArray(this->radius);
+        padArray(this->colors);
+    }
+
+    template <Type T>
+    static inline simd::vfloat poolSDF(const Pool &pool, size_t idx, simd::vfloat px, simd::vfloat py, simd::vfloat pz);
+
+    template <>
+    inline simd::vfloat poolSDF<Type::SPHERE>(const Pool &pool, size_t idx, simd::vfloat px, simd::vfloat py, simd::vfloat pz) {
+        simd::vfloat dx = simd::sub(simd::load(&pool.x[idx]), px);
+        simd::vfloat dy = simd::sub(simd::load(&pool.y[idx]), py);
+        simd::vfloat dz = simd::sub(simd::load(&pool.z[idx]), pz);
+        simd::vfloat squared = simd::add(simd::add(simd::mul(dx, dx), simd::mul(dy, dy)), simd::mul(dz, dz));
+        return simd::sub(simd::sqrt(squared), simd::load(&pool.radius[idx]));
+    }
+
+    template <>
+    inline simd::vfloat poolSDF<Type::BOX>(const Pool &pool, size_t idx, simd::vfloat px, simd::vfloat py, simd::vfloat pz) {
+        simd::vfloat dx = simd::sub(simd::abs(simd::sub(px, simd::load(&pool.x[idx]))), simd::load(&pool.sx[idx]));
+        simd::vfloat dy = simd::sub(simd::abs(simd::sub(py, simd::load(&pool.y[idx]))), simd::load(&pool.sy[idx]));
+        simd::vfloat dz = simd::sub(simd::abs(simd::sub(pz, simd::load(&pool.z[idx]))), simd::load(&pool.sz[idx]));
+        return simd::max(simd::max(dx, dy), dz);
+    }
+
+    template <>
+    inline simd::vfloat poolSDF<Type::CROSS>(const Pool &pool, size_t idx, simd::vfloat px, simd::vfloat py, simd::vfloat pz) {
+        simd::vfloat dx = simd::sub(simd::abs(simd::sub(px, simd::load(&pool.x[idx]))), simd::load(&pool.sx[idx]));
+        simd::vfloat dy = simd::sub(simd::abs(simd::sub(py, simd::load(&pool.y[idx]))), simd::load(&pool.sy[idx]));
+        simd::vfloat dz = simd::sub(simd::abs(simd::sub(pz, simd::load(&pool.z[idx]))), simd::load(&pool.sz[idx]));
+        simd::vfloat dmin = simd::min(simd::min(dx, dy), dz);
+        simd::vfloat dmax = simd::max(simd::max(dx, dy), dz);
+        return simd::sub(simd::sub(simd::add(simd::add(dx, dy), dz), dmin), dmax);
+    }
+
+    // Reduce the pool to its closest (or farthest) body, ties resolve to the earliest one
+    template <Type T, bool maximum, bool track>
+    static float poolReduce(const Pool &pool, float3 position, float limit, size_t &winner) {
+        float initial = std::numeric_limits<float>::infinity();
+        if (maximum) initial = -initial;
+
+        float lane[simd::lanes];
+        for (int idx = 0; idx < simd::lanes; idx++) lane[idx] = idx;
+
+        simd::vfloat px = simd::set(position.x);
+        simd::vfloat py = simd::set(position.y);
+        simd::vfloat pz = simd::set(position.z);
+        simd::vfloat best = simd::set(initial);
+        simd::vfloat index = simd::set(0.0f);
+        simd::vfloat current = simd::load(lane);
+        simd::vfloat step = simd::set(simd::lanes);
+        simd::vfloat bound = simd::set(limit);
+
+        for (size_t idx = 0; idx < pool.x.size(); idx += simd::lanes) {
+            simd::vfloat distance = poolSDF<T>(pool, idx, px, py, pz);
+            if (track) {
+                simd::vmask better = maximum ? simd::gt(distance, best) : simd::lt(distance, best);
+                index = simd::select(better, current, index);
+                current = simd::add(current, step);
+            }
+            best = maximum ? simd::max(distance, best) : simd::min(distance, best);
+
+            // The fold of the pool is decided once any body passes the limit
+            simd::vmask passed = maximum ? simd::gt(best, bound) : simd::lt(best, bound);
+            if (simd::any(passed) && idx + simd::lanes < pool.x.size()) {
+                stats::add(stats::EXITS);
+                stats::add(stats::SKIPPED, pool.x.size() - idx - simd::lanes);
+                break;
+            }
+        }
+
+        float bests[simd::lanes], indices[simd::lanes];
+        simd::store(bests, best);
+        simd::store(indices, index);
+
+        float distance = initial;
+        float nearest = 0.0f;
+        for (int idx = 0; idx < simd::lanes; idx++) {
+            bool better = maximum ? bests[idx] > distance : bests[idx] < distance;
+            bool tie = bests[idx] == distance && indices[idx] < nearest;
+            if (better || (track && tie)) {
+                distance = bests[idx];
+                nearest = indices[idx];
+            }
+        }
+
+        winner = static_cast<size_t>(nearest);
+        return distance;
+    }
+
+    template <bool track>
+    static float poolDispatch(const Pool &pool, float3 position, bool maximum, float limit, size_t &index) {
+        switch (pool.type) {
+            case Type::SPHERE:
+                return maximum ? poolReduce<Type::SPHERE, true, track>(pool, position, limit, index) : poolReduce<Type::SPHERE, false, track>(pool, position, limit, index);
+            case Type::BOX:
+                return maximum ? poolReduce<Type::BOX, true, track>(pool, position, limit, index) : poolReduce<Type::BOX, false, track>(pool, position, limit, index);
+            case Type::CROSS:
+                return maximum ? poolReduce<Type::CROSS, true, track>(pool, position, limit, index) : poolReduce<Type::CROSS, false, track>(pool, position, limit, index);
+            default: break;
+        }
+        index = 0;
+        return std::numeric_limits<float>::infinity();
+    }
+
+    float Pool::distance(float3 position, bool maximum, float limit) const {
+        size_t index;
+        return poolDispatch<false>(*this, position, maximum, limit, index);
+    }
+
+    float Pool::nearest(float3 position, bool maximum, float limit, size_t &index) const {
+        return poolDispatch<true>(*this, position, maximum, limit, index);
+    }
+
+    Surface Pool::SDF(float3 position, bool maximum, float limit) const {
+        size_t index;
+        float distance = this->nearest(position, maximum, limit, index);
+        if (this->colors.empty()) return { .SD = distance, .color = float3(0.0f) };
+        return { .SD = distance, .color = this->colors[index] };
+    }
+
+    // Pooled bodies staying above limit over the segment are skipped
+    float Pool::lipschitz(float3 origin, float3 ray, float length, float limit) const {
+        if (this->type == Type::CROSS) return this->count > 0 ? axial(ray) : 0.0f;
+
+        float bound = 0.0f;
+        for (size_t idx = 0; idx < this->count; idx++) {
+            float3 center = float3(this->x[idx], this->y[idx], this->z[idx]);
+            float3 size = this->type == Type::SPHERE ? float3(this->radius[idx])
+                                                     : float3(this->sx[idx], this->sy[idx], this->sz[idx]);
+            Bounds bounds = { .lower = center - size, .upper = center + size };
+            if (bounds.SDF(origin) - length > limit) continue;
+            if (this->type != Type::SPHERE) return axial(ray);
+            bound = std::max(bound, radial(origin, ray, center, length));
+        }
+        return bound;
+    }
+
     /// List ///
-    List::List(Mode mode) : Base(Type::LIST), mode(mode) {}
+    List::List(Mode mode) : List(Type::LIST, mode) {}
+
+    List::List(Type type, Mode mode) : Base(type), mode(mode), bound(Bounds::infinite()), packed(false) {}
 
     void List::append(Base *body) {
         this->bodies.push_back(body);
     }
 
-    Surface List::SDF(float3 position) {
+    static bool poolable(Type type) {
+        return type == Type::SPHERE || type == Type::BOX || type == Type::CROSS;
+    }
+
+    // Group same-type children into pools, the first child always stays loose
+    void List::pack() {
+        this->loose.clear();
+        this->pools.clear();
+
+        std::map<Type, size_t> counts;
+        for (size_t idx = 1; idx < this->bodies.size(); idx++)
+            counts[this->bodies[idx]->type]++;
+
+        std::map<Type, Pool*> typed;
+        for (size_t idx = 0; idx < this->bodies.size(); idx++) {
+            Base *body = this->bodies[idx];
+            if (composite(body->type))
+                static_cast<List*>(body)->pack();
+
+            if (idx == 0 || !poolable(body->type) || counts[body->type] < constants::pool::threshold) {
+                this->loose.push_back(body);
+                continue;
+            }
+
+            Pool *&pool = typed[body->type];
+            if (!pool) {
+                pool = new Pool(body->type);
+                this->pools.push_back(pool);
+            }
+            pool->append(body);
+        }
+
+        for (Pool *pool : this->pools)
+            pool->pad();
+        this->packed = true;
+    }
+
+    // Fit the list bounds to its children
+    void List::fit() {
         if (this->bodies.empty()) {
+            this->bound = Bounds::empty();
+            return;
+        }
+
+        for (Base *body : this->bodies) {
+            if (composite(body->type))
+                static_cast<List*>(body)->fit();
+        }
+
+        switch (this->mode) {
+            case Mode::UNION:
+            {
+                this->bound = Bounds::empty();
+                for (Base *body : this->bodies)
+                    this->bound = Bounds::merge(this->bound, body->bounds());
+                break;
+            }
+
+            case Mode::COMPLEMENT:
+            {
+                this->bound = Bounds::infinite();
+                break;
+            }
+
+            case Mode::INTERSECTION:
+            {
+                this->bound = Bounds::infinite();
+                for (Base *body : this->bodies)
+                    this->bound = Bounds::intersect(this->bound, body->bounds());
+                break;
+            }
+
+            case Mode::DIFFERENCE:
+            {
+                this->bound = this->bodies[0]->bounds();
+                break;
+            }
+
+            default: break;
+        }
+    }
+
+    Bounds List::bounds() {
+        return this->bound;
+    }
+
+    // Whether a child with the given bounds can't change the surface folded so far
+    static bool skippable(Mode mode, const Surface &surface, Base *body, float3 position) {
+        if (!composite(body->type)) return false;
+        switch (mode) {
+            case Mode::UNION:
+                return body->bounds().SDF(position) >= surface.SD;
+            case Mode::DIFFERENCE:
+                return body->bounds().SDF(position) >= -surface.SD;
+            default: break;
+        }
+        return false;
+    }
+
+    static Surface apply(Mode mode, const Surface &surface, const Surface &current) {
+        switch (mode) {
+            case Mode::UNION:
+                return min(surface, current);
+
+            case Mode::COMPLEMENT:
+                return min(surface, -current);
+
+            case Mode::INTERSECTION:
+                return max(surface, current);
+
+            case Mode::DIFFERENCE:
+                return max(surface, -current);
+
+            default: break;
+        }
+        return surface;
+    }
+
+    // Limit of a child beyond which it can't change the surface folded so far or the result below the list limit
+    static float childLimit(Mode mode, const Surface &surface, float limit) {
+        switch (mode) {
+            case Mode::UNION:
+                return min(surface.SD, limit);
+            case Mode::INTERSECTION:
+                return limit;
+            case Mode::DIFFERENCE:
+                return -surface.SD;
+            default: break;
+        }
+        return std::numeric_limits<float>::infinity();
+    }
+
+    static Surface childSDF(Base *body, float3 position, float limit) {
+        if (!composite(body->type)) return body->SDF(position);
+        return static_cast<List*>(body)->SDF(position, limit);
+    }
+
+    // Intersections and differences only grow, past the limit the rest of the children can't matter
+    static bool exits(Mode mode, const Surface &surface, float limit) {
+        if (!constants::shortcut::enabled) return false;
+        if (mode != Mode::INTERSECTION && mode != Mode::DIFFERENCE) return false;
+        return surface.SD >= limit;
+    }
+
+    Surface List::SDF(float3 position) {
+        return this->SDF(position, std::numeric_limits<float>::infinity());
+    }
+
+    Surface List::SDF(float3 position, float limit) {
+        const std::vector<Base*> &bodies = this->packed ? this->loose : this->bodies;
+        if (bodies.empty()) {
             float distance = std::numeric_limits<float>::infinity();
             return { .SD = distance, .color = float3(0.0f) };
         }
 
-        Base *body = this->bodies[0];
-        Surface surface = body->SDF(position);
+        float infinity = std::numeric_limits<float>::infinity();
+        Base *body = bodies[0];
+        Surface surface = childSDF(body, position, this->mode == Mode::COMPLEMENT ? infinity : limit);
         if (this->mode == Mode::COMPLEMENT)
             surface = -surface;
 
-        for (size_t idx = 1; idx < this->bodies.size(); idx++) {
-            body = this->bodies[idx];
-            Surface current = body->SDF(position);
-
-            switch (this->mode) {
-                case Mode::UNION:
-                {
-                    surface = min(surface, current);
-                    break;
-                }
-
-                case Mode::COMPLEMENT:
-                {
-                    surface = min(surface, -current);
-                    break;
-                }
-
-                case Mode::INTERSECTION:
-                {
-                    surface = max(surface, current);
-                    break;
-                }
-
-                case Mode::DIFFERENCE:
-                {
-                    surface = max(surface, -current);
-                    break;
-                }
-
-                defaut: break;
+        for (size_t idx = 1; idx < bodies.size(); idx++) {
+            if (exits(this->mode, surface, limit)) {
+                stats::add(stats::EXITS);
+                stats::add(stats::SKIPPED, bodies.size() - idx);
+                for (Pool *pool : this->pools)
+                    stats::add(stats::SKIPPED, pool->count);
+                return surface;
+            }
+
+            body = bodies[idx];
+            if (skippable(this->mode, surface, body, position)) continue;
+            surface = apply(this->mode, surface, childSDF(body, position, childLimit(this->mode, surface, limit)));
+        }
+
+        // Union and difference fold the closest pooled body, the other modes the farthest
+        bool maximum = this->mode == Mode::INTERSECTION || this->mode == Mode::COMPLEMENT;
+        for (size_t idx = 0; idx < this->pools.size(); idx++) {
+            if (exits(this->mode, surface, limit)) {
+                stats::add(stats::EXITS);
+                for (; idx < this->pools.size(); idx++)
+                    stats::add(stats::SKIPPED, this->pools[idx]->count);
+                return surface;
             }
+
+            // Pools stop at the limit of the fold, folding the closest body negates it
+            float bound = maximum ? infinity : -infinity;
+            if (constants::shortcut::enabled && this->mode == Mode::INTERSECTION) bound = limit;
+            if (constants::shortcut::enabled && this->mode == Mode::DIFFERENCE) bound = -limit;
+            surface = apply(this->mode, surface, this->pools[idx]->SDF(position, maximum, bound));
         }
 
         return surface;
     }
 
+    float List::lipschitz(float3 origin, float3 ray, float length) {
+        return this->lipschitz(origin, ray, length, std::numeric_limits<float>::infinity());
+    }
+
+    // Folds change no faster than their fastest child, in a union only children reaching limit can decide it
+    float List::lipschitz(float3 origin, float3 ray, float length, float limit) {
+        if (this->mode != Mode::UNION) limit = std::numeric_limits<float>::infinity();
+        const std::vector<Base*> &bodies = this->packed ? this->loose : this->bodies;
+
+        float bound = 0.0f;
+        for (Base *body : bodies) {
+            if (body->bounds().SDF(origin) - length > limit) continue;
+            float child = composite(body->type) ? static_cast<List*>(body)->lipschitz(origin, ray, length, limit)
+                                                : body->lipschitz(origin, ray, length);
+            bound = std::max(bound, child);
+        }
+        for (Pool *pool : this->pools)
+            bound = std::max(bound, pool->lipschitz(origin, ray, length, limit));
+        return bound;
+    }
+
+    /// Repeat ///
+    Repeat::Repeat(float3 position, float3 period, int3 count, Mode mode) :
+        List(Type::REPEAT, mode), position(position), period(period), count(count) {}
+
+    // Move the position into the cell centered at the repeat position
+    float3 Repeat::map(float3 position) const {
+        float3 local = position - this->position;
+        for (int axis = 0; axis < 3; axis++) {
+            float period = this->period[axis];
+            if (period == 0.0f) continue;
+
+            int count = this->count[axis];
+            float half = count > 0 ? (count - 1) / 2.0f : 0.0f;
+            float cell = std::floor(local[axis] / period + half + 0.5f);
+            if (count > 0) cell = clamp(cell, 0.0f, float(count - 1));
+            local[axis] -= period * (cell - half);
+        }
+        return local + this->position;
+    }
+
+    // Cover every copy of the children
+    void Repeat::fit() {
+        List::fit();
+        if (this->bound.lower.x > this->bound.upper.x) return;
+
+        float infinity = std::numeric_limits<float>::infinity();
+        for (int axis = 0; axis < 3; axis++) {
+            float period = std::abs(this->period[axis]);
+            if (period == 0.0f) continue;
+
+            int count = this->count[axis];
+            float reach = count > 0 ? period * (count - 1) / 2.0f : infinity;
+            this->bound.lower[axis] -= reach;
+            this->bound.upper[axis] += reach;
+        }
+    }
+
+    Surface Repeat::SDF(float3 position, float limit) {
+        return List::SDF(this->map(position), limit);
+    }
+
+    // A segment leaving the cell meets other copies, only the bounds along the ray direction hold there
+    float Repeat::lipschitz(float3 origin, float3 ray, float length, float limit) {
+        float3 mapped = this->map(origin);
+        float3 end = mapped - this->position + length * ray;
+        for (int axis = 0; axis < 3; axis++) {
+            float period = std::abs(this->period[axis]);
+            if (period > 0.0f && !(std::abs(end[axis]) <= period / 2)) {
+                float infinity = std::numeric_limits<float>::infinity();
+                return List::lipschitz(mapped, ray, infinity, infinity);
+            }
+        }
+        return List::lipschitz(mapped, ray, length, limit);
+    }
+
+    /// Mirror ///
+    Mirror::Mirror(float3 position, float3 normal, Mode mode) :
+        List(Type::MIRROR, mode), position(position), normal(normalize(normal)) {}
+
+    float3 Mirror::map(float3 position) const {
+        float height = dot(position - this->position, this->normal);
+        return position - 2 * min(height, 0.0f) * this->normal;
+    }
+
+    // Cover the children and their reflection
+    void Mirror::fit() {
+        List::fit();
+        Bounds bound = this->bound;
+        if (bound.lower.x > bound.upper.x) return;
+
+        bool finite = true;
+        for (int axis = 0; axis < 3; axis++)
+            finite = finite && std::isfinite(bound.lower[axis]) && std::isfinite(bound.upper[axis]);
+        if (!finite) {
+            this->bound = Bounds::infinite();
+            return;
+        }
+
+        for (int corner = 0; corner < 8; corner++) {
+            float3 point = float3(
+                corner & 1 ? bound.upper.x : bound.lower.x,
+                corner & 2 ? bound.upper.y : bound.lower.y,
+                corner & 4 ? bound.upper.z : bound.lower.z);
+            float height = dot(point - this->position, this->normal);
+            point -= 2 * height * this->normal;
+            this->bound = Bounds::merge(this->bound, { .lower = point, .upper = point });
+        }
+    }
+
+    Surface Mirror::SDF(float3 position, float limit) {
+        return List::SDF(this->map(position), limit);
+    }
+
+    // Reflected children see the reflected ray, a segment crossing the plane sees both directions
+    float Mirror::lipschitz(float3 origin, float3 ray, float length, float limit) {
+        float3 reflected = ray - 2 * dot(ray, this->normal) * this->normal;
+        float start = dot(origin - this->position, this->normal);
+        float end = start + length * dot(ray, this->normal);
+        if (start >= 0.0f && end >= 0.0f) return List::lipschitz(origin, ray, length, limit);
+        if (start < 0.0f && end < 0.0f) return List::lipschitz(this->map(origin), reflected, length, limit);
+
+        float infinity = std::numeric_limits<float>::infinity();
+        return std::max(List::lipschitz(origin, ray, infinity, infinity),
+                        List::lipschitz(origin, reflected, infinity, infinity));
+    }
+
     /// Menger Sponge /// 
     static void generateMengerSponge(List* result, float3 position, float size, int iterations, float3 color) {
         float d = size / 3;
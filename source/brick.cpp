@@ -0,0 +1,267 @@
+#include <LiteMath.h>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <iostream>
+
+#include "constants.h"
+#include "body.h"
+#include "tape.h"
+#include "brick.h"
+
+using namespace LiteMath;
+
+namespace Brick {
+    static const float diagonal = std::sqrt(3.0f) / 2.0f;
+
+    // Index of the sample at coord in a grid of extent samples per axis
+    static size_t sample(int3 coord, int3 extent) {
+        return (size_t(coord.z) * extent.y + coord.y) * extent.x + coord.x;
+    }
+
+    static int3 vertex(int3 coord, int corner) {
+        return int3(coord.x + (corner & 1), coord.y + ((corner >> 1) & 1), coord.z + (corner >> 2));
+    }
+
+    static float3 point(int3 coord) {
+        return float3(float(coord.x), float(coord.y), float(coord.z));
+    }
+
+    // Bounds of the distance inside the grid cell at coord, fraction is the position within the cell
+    // Trilinear weights keep the interpolated samples within half a cell diagonal of the distance,
+    // and the distance changes at most by the way to each sample
+    static float lookup(const float *values, int3 extent, int3 coord, float3 fraction, float size, float &upper) {
+        float corners[8];
+        float lower = -std::numeric_limits<float>::infinity();
+        upper = std::numeric_limits<float>::infinity();
+        for (int corner = 0; corner < 8; corner++) {
+            corners[corner] = values[sample(vertex(coord, corner), extent)];
+            float3 offset = fraction - point(vertex(int3(0, 0, 0), corner));
+            float way = size * length(offset);
+            lower = std::max(lower, corners[corner] - way);
+            upper = std::min(upper, corners[corner] + way);
+        }
+        float x00 = corners[0] + (corners[1] - corners[0]) * fraction.x;
+        float x10 = corners[2] + (corners[3] - corners[2]) * fraction.x;
+        float x01 = corners[4] + (corners[5] - corners[4]) * fraction.x;
+        float x11 = corners[6] + (corners[7] - corners[6]) * fraction.x;
+        float y0 = x00 + (x10 - x00) * fraction.y;
+        float y1 = x01 + (x11 - x01) * fraction.y;
+        float interpolated = y0 + (y1 - y0) * fraction.z;
+        upper = std::min(upper, interpolated + diagonal * size);
+        return std::max(lower, interpolated - diagonal * size);
+    }
+
+    // Cell of the position inside a grid of cells per axis and the position within it
+    static int3 locate(float3 local, int3 cells, float3 &fraction) {
+        int3 coord;
+        for (int axis = 0; axis < 3; axis++) {
+            coord[axis] = std::min(std::max(int(std::floor(local[axis])), 0), cells[axis] - 1);
+            fraction[axis] = std::min(std::max(local[axis] - coord[axis], 0.0f), 1.0f);
+        }
+        return coord;
+    }
+
+    // The grid is padded by a cell around the bounds, so the outside of the grid is far from the geometry
+    static void layout(const Body::Bounds &bounds, float3 &lower, float &cell, int3 &cells) {
+        float3 extent = bounds.upper - bounds.lower;
+        cell = std::max(std::max(extent.x, extent.y), extent.z) / constants::brick::cells;
+        lower = bounds.lower - float3(cell);
+        for (int axis = 0; axis < 3; axis++)
+            cells[axis] = int(std::ceil(extent[axis] / cell)) + 2;
+    }
+
+    void Map::bake(const Tape::Program &program, const Body::Bounds &bounds) {
+        layout(bounds, this->lower, this->cell, this->cells);
+
+        // Vertices per axis, the far corner of the last cell
+        int3 grid = vertex(this->cells, 7);
+        int vertices = grid.x * grid.y * grid.z;
+        this->coarse.resize(vertices);
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (int index = 0; index < vertices; index++) {
+            int3 coord = int3(index % grid.x, index / grid.x % grid.y, index / (grid.x * grid.y));
+            this->coarse[index] = program.distance(this->lower + point(coord) * this->cell);
+        }
+
+        // Every position of a cell is within its diagonal of each vertex
+        int count = this->cells.x * this->cells.y * this->cells.z;
+        float band = this->cell * (2.0f * diagonal + constants::brick::band);
+        this->bricks.assign(count, -1);
+        int total = 0;
+        for (int index = 0; index < count; index++) {
+            int3 coord = int3(index % this->cells.x, index / this->cells.x % this->cells.y,
+                              index / (this->cells.x * this->cells.y));
+            float nearest = std::abs(this->coarse[sample(coord, grid)]);
+            for (int corner = 1; corner < 8; corner++)
+                nearest = std::min(nearest, std::abs(this->coarse[sample(vertex(coord, corner), grid)]));
+            if (nearest <= band) this->bricks[index] = total++;
+        }
+
+        float size = this->cell / constants::brick::resolution;
+        this->fine.resize(size_t(total) * samples);
+        #pragma omp parallel for schedule(dynamic)
+        for (int index = 0; index < count; index++) {
+            if (this->bricks[index] < 0) continue;
+            int3 coord = int3(index % this->cells.x, index / this->cells.x % this->cells.y,
+                              index / (this->cells.x * this->cells.y));
+            float3 corner = this->lower + point(coord) * this->cell;
+            float *values = &this->fine[size_t(this->bricks[index]) * samples];
+            for (int idx = 0; idx < samples; idx++) {
+                int3 local = int3(idx % side, idx / side % side, idx / (side * side));
+                values[idx] = program.distance(corner + point(local) * size);
+            }
+        }
+        this->active = true;
+    }
+
+    // The cache is used only when it was written for the same key and holds the grid of the bounds
+    bool Map::load(const char *path, uint64_t key, const Body::Bounds &bounds) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) return false;
+        uint64_t length = uint64_t(file.tellg());
+        file.seekg(0);
+
+        uint64_t stored = 0;
+        file.read(reinterpret_cast<char*>(&stored), sizeof(stored));
+        if (!file || stored != key) return false;
+
+        float3 lower;
+        float cell;
+        int3 cells;
+        layout(bounds, lower, cell, cells);
+        int3 grid = vertex(cells, 7);
+        uint64_t vertices = uint64_t(grid.x) * grid.y * grid.z;
+        uint64_t count = uint64_t(cells.x) * cells.y * cells.z;
+
+        // Sizes are checked against the expected grid and the file length before anything is allocated
+        uint64_t sizes[3];
+        file.read(reinterpret_cast<char*>(&this->lower), sizeof(this->lower));
+        file.read(reinterpret_cast<char*>(&this->cell), sizeof(this->cell));
+        file.read(reinterpret_cast<char*>(&this->cells), sizeof(this->cells));
+        file.read(reinterpret_cast<char*>(sizes), sizeof(sizes));
+        uint64_t header = sizeof(stored) + sizeof(this->lower) + sizeof(this->cell) + sizeof(this->cells) + sizeof(sizes);
+        bool valid = file && this->cell == cell;
+        for (int axis = 0; axis < 3; axis++)
+            valid = valid && this->lower[axis] == lower[axis] && this->cells[axis] == cells[axis];
+        valid = valid && sizes[0] == vertices && sizes[1] == count && sizes[2] % samples == 0 &&
+                sizes[2] <= length && length == header + (sizes[0] + sizes[2]) * sizeof(float) + sizes[1] * sizeof(int);
+        if (valid) {
+            this->coarse.resize(sizes[0]);
+            this->bricks.resize(sizes[1]);
+            this->fine.resize(sizes[2]);
+            file.read(reinterpret_cast<char*>(this->coarse.data()), sizes[0] * sizeof(float));
+            file.read(reinterpret_cast<char*>(this->bricks.data()), sizes[1] * sizeof(int));
+            file.read(reinterpret_cast<char*>(this->fine.data()), sizes[2] * sizeof(float));
+            int total = int(sizes[2] / samples);
+            valid = bool(file);
+            for (int brick : this->bricks)
+                valid = valid && brick >= -1 && brick < total;
+        }
+        if (!valid) {
+            std::cout << "[Error] Brick map cache " << path << " doesn't match the scene, rebuilding" << std::endl;
+            *this = Map();
+            return false;
+        }
+
+        this->active = true;
+        return true;
+    }
+
+    void Map::save(const char *path, uint64_t key) const {
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            std::cout << "[Error] Can't write brick map cache " << path << std::endl;
+            return;
+        }
+
+        uint64_t sizes[3] = { this->coarse.size(), this->bricks.size(), this->fine.size() };
+        file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+        file.write(reinterpret_cast<const char*>(&this->lower), sizeof(this->lower));
+        file.write(reinterpret_cast<const char*>(&this->cell), sizeof(this->cell));
+        file.write(reinterpret_cast<const char*>(&this->cells), sizeof(this->cells));
+        file.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+        file.write(reinterpret_cast<const char*>(this->coarse.data()), sizes[0] * sizeof(float));
+        file.write(reinterpret_cast<const char*>(this->bricks.data()), sizes[1] * sizeof(int));
+        file.write(reinterpret_cast<const char*>(this->fine.data()), sizes[2] * sizeof(float));
+    }
+
+    // Lower bound of the distance, 0 when it is too loose and the exact distance should be taken
+    float Map::distance(float3 position) const {
+        float3 local = (position - this->lower) / this->cell;
+
+        // Outside of the grid the padding cell lies between the position and the geometry
+        float outside = 0.0f;
+        for (int axis = 0; axis < 3; axis++)
+            outside = std::max(outside, std::max(-local[axis], local[axis] - this->cells[axis]));
+        if (outside > 0.0f) return (outside + 1.0f) * this->cell;
+
+        float3 fraction;
+        int3 coord = locate(local, this->cells, fraction);
+        int brick = this->bricks[sample(coord, this->cells)];
+        float lower, upper;
+        if (brick < 0) lower = lookup(this->coarse.data(), vertex(this->cells, 7), coord, fraction, this->cell, upper);
+        else {
+            static const int resolution = constants::brick::resolution;
+            int3 fineCoord = locate(fraction * float(resolution), int3(resolution), fraction);
+            lower = lookup(&this->fine[size_t(brick) * samples], int3(side), fineCoord, fraction,
+                           this->cell / resolution, upper);
+        }
+        return lower > constants::brick::tightness * upper ? lower : 0.0f;
+    }
+
+    // FNV-1a over the bytes of value
+    template <typename T>
+    static void hash(uint64_t &key, const T &value) {
+        const unsigned char *bytes = reinterpret_cast<const unsigned char*>(&value);
+        for (size_t idx = 0; idx < sizeof(T); idx++) {
+            key ^= bytes[idx];
+            key *= 1099511628211ull;
+        }
+    }
+
+    static void hash(uint64_t &key, float3 value) {
+        hash(key, value.x);
+        hash(key, value.y);
+        hash(key, value.z);
+    }
+
+    template <typename T>
+    static void hash(uint64_t &key, const std::vector<T> &values) {
+        for (const T &value : values)
+            hash(key, value);
+    }
+
+    // Key of everything the baked distances depend on: the compiled geometry, its bounds and the map layout
+    // Programs that evaluate the tree have no code to hash and must not be cached
+    uint64_t key(const Tape::Program &program, const Body::Bounds &bounds) {
+        uint64_t key = 14695981039346656037ull;
+        hash(key, constants::brick::cells);
+        hash(key, constants::brick::resolution);
+        hash(key, constants::brick::band);
+        hash(key, bounds.lower);
+        hash(key, bounds.upper);
+        for (const Tape::Instruction &instruction : program.code) {
+            hash(key, instruction.op);
+            hash(key, instruction.fold);
+            hash(key, instruction.position);
+            hash(key, instruction.size);
+            hash(key, instruction.count);
+            hash(key, instruction.skip);
+            if (instruction.pool == nullptr) continue;
+            const Body::Pool *pool = instruction.pool;
+            hash(key, pool->type);
+            hash(key, pool->count);
+            hash(key, pool->x);
+            hash(key, pool->y);
+            hash(key, pool->z);
+            hash(key, pool->sx);
+            hash(key, pool->sy);
+            hash(key, pool->sz);
+            hash(key, pool->radius);
+        }
+        return key;
+    }
+}
@@ -0,0 +1,189 @@
+#include <LiteMath.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "constants.h"
+#include "body.h"
+#include "tape.h"
+#include "bvh.h"
+
+using namespace LiteMath;
+
+namespace BVH {
+    static bool bounded(const Body::Bounds &bounds) {
+        for (int axis = 0; axis < 3; axis++) {
+            if (!std::isfinite(bounds.lower[axis]) || !std::isfinite(bounds.upper[axis]))
+                return false;
+        }
+        return true;
+    }
+
+    // Split items by the median centroid along the widest axis
+    static uint split(Tree &tree, const std::vector<Body::Bounds> &bounds, size_t begin, size_t end) {
+        uint index = tree.nodes.size();
+        tree.nodes.push_back(Node { .bounds = Body::Bounds::empty(), .first = 0U, .count = 0U });
+
+        Body::Bounds box = Body::Bounds::empty();
+        Body::Bounds centroids = Body::Bounds::empty();
+        for (size_t idx = begin; idx < end; idx++) {
+            const Body::Bounds &item = bounds[tree.items[idx]];
+            float3 centroid = (item.lower + item.upper) / 2;
+            box = Body::Bounds::merge(box, item);
+            centroids = Body::Bounds::merge(centroids, { .lower = centroid, .upper = centroid });
+        }
+        tree.nodes[index].bounds = box;
+
+        if (end - begin <= constants::bvh::leafSize) {
+            tree.nodes[index].first = begin;
+            tree.nodes[index].count = end - begin;
+            return index;
+        }
+
+        float3 extent = centroids.upper - centroids.lower;
+        int axis = 0;
+        if (extent.y > extent[axis]) axis = 1;
+        if (extent.z > extent[axis]) axis = 2;
+
+        size_t middle = (begin + end) / 2;
+        std::nth_element(tree.items.begin() + begin, tree.items.begin() + middle, tree.items.begin() + end,
+            [&bounds, axis](uint left, uint right) {
+                return bounds[left].lower[axis] + bounds[left].upper[axis] <
+                       bounds[right].lower[axis] + bounds[right].upper[axis];
+            });
+
+        split(tree, bounds, begin, middle);
+        uint right = split(tree, bounds, middle, end);
+        tree.nodes[index].first = right;
+        return index;
+    }
+
+    void Tree::build(Body::List *list) {
+        this->nodes.clear();
+        this->items.clear();
+        this->unbounded.clear();
+        this->programs.resize(list->bodies.size());
+
+        std::vector<Body::Bounds> bounds;
+        for (uint idx = 0; idx < list->bodies.size(); idx++) {
+            Body::Base *body = list->bodies[idx];
+            Tape::compile(body, this->programs[idx]);
+            bounds.push_back(body->bounds());
+            if (bounded(bounds.back())) this->items.push_back(idx);
+            else this->unbounded.push_back(idx);
+        }
+
+        if (!this->items.empty())
+            split(*this, bounds, 0, this->items.size());
+        this->active = true;
+    }
+
+    // Pending node ordered by its bounds distance
+    struct Entry {
+        float distance;
+        uint node;
+    };
+
+    static bool farther(const Entry &left, const Entry &right) {
+        return left.distance > right.distance;
+    }
+
+    static inline float distance(const Body::Surface &surface) {
+        return surface.SD;
+    }
+
+    static inline float distance(float value) {
+        return value;
+    }
+
+    static inline float distance(const Tape::Dual &dual) {
+        return dual.SD;
+    }
+
+    // Children are limited by the closest surface, beyond it they can't win
+    static void fold(const Tape::Program &program, float3 position, Body::Surface &surface) {
+        Body::Surface current = program.SDF(position, surface.SD);
+        if (current.SD < surface.SD) surface = current;
+    }
+
+    static void fold(const Tape::Program &program, float3 position, float &surface) {
+        surface = min(surface, program.distance(position, surface));
+    }
+
+    static void fold(const Tape::Program &program, float3 position, Tape::Dual &surface) {
+        Tape::Dual current = program.gradient(position, surface.SD);
+        if (current.SD < surface.SD) surface = current;
+    }
+
+    // Depth-first fallback once the heap is full
+    template <typename V>
+    static void descend(const Tree &tree, uint index, float3 position, V &surface) {
+        const Node &node = tree.nodes[index];
+        if (node.bounds.SDF(position) >= distance(surface)) return;
+
+        if (node.count > 0) {
+            for (uint idx = node.first; idx < node.first + node.count; idx++)
+                fold(tree.programs[tree.items[idx]], position, surface);
+            return;
+        }
+
+        descend(tree, index + 1, position, surface);
+        descend(tree, node.first, position, surface);
+    }
+
+    // Best-first nearest distance query pruned by the closest surface found so far
+    template <typename V>
+    static void query(const Tree &tree, float3 position, V &surface) {
+        for (uint idx : tree.unbounded)
+            fold(tree.programs[idx], position, surface);
+        if (tree.nodes.empty()) return;
+
+        Entry heap[constants::bvh::heapMax];
+        size_t size = 0;
+        heap[size++] = { .distance = tree.nodes[0].bounds.SDF(position), .node = 0U };
+
+        while (size > 0) {
+            std::pop_heap(heap, heap + size, farther);
+            Entry entry = heap[--size];
+            if (entry.distance >= distance(surface)) break;
+
+            const Node &node = tree.nodes[entry.node];
+            if (node.count > 0) {
+                for (uint idx = node.first; idx < node.first + node.count; idx++)
+                    fold(tree.programs[tree.items[idx]], position, surface);
+                continue;
+            }
+
+            uint children[2] = { entry.node + 1, node.first };
+            for (uint child : children) {
+                float bound = tree.nodes[child].bounds.SDF(position);
+                if (bound >= distance(surface)) continue;
+                if (size == constants::bvh::heapMax) {
+                    descend(tree, child, position, surface);
+                    continue;
+                }
+                heap[size++] = { .distance = bound, .node = child };
+                std::push_heap(heap, heap + size, farther);
+            }
+        }
+    }
+
+    Body::Surface Tree::SDF(float3 position) const {
+        float distance = std::numeric_limits<float>::infinity();
+        Body::Surface surface = { .SD = distance, .color = float3(0.0f) };
+        query(*this, position, surface);
+        return surface;
+    }
+
+    float Tree::distance(float3 position) const {
+        float surface = std::numeric_limits<float>::infinity();
+        query(*this, position, surface);
+        return surface;
+    }
+
+    Tape::Dual Tree::gradient(float3 position) const {
+        Tape::Dual surface = { .SD = std::numeric_limits<float>::infinity(), .grad = float3(0.0f) };
+        query(*this, position, surface);
+        return surface;
+    }
+}
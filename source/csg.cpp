@@ -0,0 +1,162 @@
+#include <LiteMath.h>
+#include <algorithm>
+#include <vector>
+
+#include "constants.h"
+#include "body.h"
+#include "csg.h"
+
+using namespace LiteMath;
+
+namespace CSG {
+    size_t count(Body::Base *body) {
+        if (!Body::composite(body->type)) return 1;
+
+        size_t total = 1;
+        for (Body::Base *child : static_cast<Body::List*>(body)->bodies)
+            total += count(child);
+        return total;
+    }
+
+    /// Estimates ///
+    // Relative amount of work per SDF evaluation
+    static size_t cost(Body::Base *body) {
+        if (body->type == Body::Type::MENGER)
+            return 1 + static_cast<Body::Menger*>(body)->iterations;
+        if (!Body::composite(body->type)) return 1;
+
+        size_t total = 1;
+        for (Body::Base *child : static_cast<Body::List*>(body)->bodies)
+            total += cost(child);
+        return total;
+    }
+
+    static float volume(const Body::Bounds &bounds) {
+        float3 extent = bounds.upper - bounds.lower;
+        if (extent.x <= 0.0f || extent.y <= 0.0f || extent.z <= 0.0f) return 0.0f;
+        return extent.x * extent.y * extent.z;
+    }
+
+    static bool disjoint(const Body::Bounds &lbounds, const Body::Bounds &rbounds) {
+        Body::Bounds common = Body::Bounds::intersect(lbounds, rbounds);
+        return common.lower.x > common.upper.x || common.lower.y > common.upper.y || common.lower.z > common.upper.z;
+    }
+
+    static bool empty(Body::Base *body) {
+        return Body::composite(body->type) && static_cast<Body::List*>(body)->bodies.empty();
+    }
+
+    /// Rewrites ///
+    // Whether the children of a plain child list can join the list directly
+    static bool associative(Body::List *list, Body::Base *child, bool base) {
+        if (child->type != Body::Type::LIST) return false;
+        Body::Mode mode = static_cast<Body::List*>(child)->mode;
+        switch (list->mode) {
+            case Body::Mode::UNION:         return mode == Body::Mode::UNION;
+            case Body::Mode::INTERSECTION:  return mode == Body::Mode::INTERSECTION;
+            case Body::Mode::DIFFERENCE:    return mode == (base ? Body::Mode::DIFFERENCE : Body::Mode::UNION);
+            default: break;
+        }
+        return false;
+    }
+
+    // Cheapest children first, then the ones deciding the most space
+    static void order(Body::List *list) {
+        std::vector<Body::Base*>::iterator begin = list->bodies.begin();
+        if (list->mode == Body::Mode::DIFFERENCE) begin++;
+        else if (list->mode != Body::Mode::INTERSECTION) return;
+
+        bool difference = list->mode == Body::Mode::DIFFERENCE;
+        std::stable_sort(begin, list->bodies.end(), [difference](Body::Base *left, Body::Base *right) {
+            size_t lcost = cost(left), rcost = cost(right);
+            if (lcost != rcost) return lcost < rcost;
+
+            // Small intersected bodies reject most space, large subtracted ones carve most
+            float lvolume = volume(left->bounds()), rvolume = volume(right->bounds());
+            return difference ? lvolume > rvolume : lvolume < rvolume;
+        });
+    }
+
+    // Drop children that can't change the surface, an empty list means the whole list is empty
+    static void prune(Body::List *list) {
+        std::vector<Body::Base*> &bodies = list->bodies;
+        if (bodies.empty()) return;
+
+        switch (list->mode) {
+            case Body::Mode::DIFFERENCE:
+            {
+                Body::Bounds base = bodies[0]->bounds();
+                std::vector<Body::Base*> kept = { bodies[0] };
+                for (size_t idx = 1; idx < bodies.size(); idx++) {
+                    if (!disjoint(base, bodies[idx]->bounds())) kept.push_back(bodies[idx]);
+                }
+                bodies = kept;
+                break;
+            }
+
+            case Body::Mode::INTERSECTION:
+            {
+                Body::Bounds common = Body::Bounds::infinite();
+                for (Body::Base *body : bodies) {
+                    if (disjoint(common, body->bounds())) {
+                        bodies.clear();
+                        return;
+                    }
+                    common = Body::Bounds::intersect(common, body->bounds());
+                }
+                break;
+            }
+
+            default: break;
+        }
+    }
+
+    // Simplify the subtree bottom-up, returns the node replacing it
+    static Body::Base* simplify(Body::Base *body, bool root) {
+        if (!Body::composite(body->type)) return body;
+        Body::List *list = static_cast<Body::List*>(body);
+
+        std::vector<Body::Base*> bodies;
+        for (size_t idx = 0; idx < list->bodies.size(); idx++) {
+            Body::Base *child = simplify(list->bodies[idx], false);
+            bool base = bodies.empty();
+
+            // Empty lists are never closer than anything
+            if (empty(child) && list->mode != Body::Mode::COMPLEMENT) {
+                bool whole = list->mode == Body::Mode::INTERSECTION || (list->mode == Body::Mode::DIFFERENCE && base);
+                if (whole) {
+                    list->bodies.clear();
+                    list->fit();
+                    return list;
+                }
+                continue;
+            }
+
+            // Splice same-mode children in place, within one GPU list
+            if (associative(list, child, base)) {
+                Body::List *nested = static_cast<Body::List*>(child);
+                size_t total = bodies.size() + nested->bodies.size() + list->bodies.size() - idx - 1;
+                if (total < constants::gpu::listMax) {
+                    bodies.insert(bodies.end(), nested->bodies.begin(), nested->bodies.end());
+                    continue;
+                }
+            }
+            bodies.push_back(child);
+        }
+        list->bodies = bodies;
+        prune(list);
+
+        // Lists of one body are the body itself, unless they complement or transform it
+        bool single = list->bodies.size() == 1 && list->mode != Body::Mode::COMPLEMENT;
+        if (!root && single && list->type == Body::Type::LIST)
+            return list->bodies[0];
+
+        order(list);
+        list->fit();
+        return list;
+    }
+
+    void optimize(Body::List *tree) {
+        simplify(tree, true);
+    }
+}
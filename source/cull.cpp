@@ -0,0 +1,105 @@
+#include <LiteMath.h>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+#include "constants.h"
+#include "simd.h"
+#include "stats.h"
+#include "body.h"
+#include "tape.h"
+#include "cull.h"
+
+using namespace LiteMath;
+
+namespace Cull {
+    void Set::build(Body::List *list) {
+        this->programs.resize(list->bodies.size());
+        this->bounds.resize(list->bodies.size());
+        for (size_t idx = 0; idx < list->bodies.size(); idx++) {
+            Tape::compile(list->bodies[idx], this->programs[idx]);
+            this->bounds[idx] = list->bodies[idx]->bounds();
+        }
+        this->active = true;
+    }
+
+    // Keys are padded to whole lanes with bounds that never undercut
+    Ray::Ray(const Set &set) : set(&set), nearest(0), traveled(0.0f) {
+        size_t count = set.programs.size();
+        size_t padded = (count + simd::lanes - 1) / simd::lanes * simd::lanes;
+        this->keys.assign(padded, std::numeric_limits<float>::infinity());
+        std::fill(this->keys.begin(), this->keys.begin() + count, -std::numeric_limits<float>::infinity());
+    }
+
+    static float distance(const Body::Surface &surface) {
+        return surface.SD;
+    }
+
+    static float distance(float value) {
+        return value;
+    }
+
+    static void evaluate(const Tape::Program &program, float3 position, float limit, Body::Surface &surface) {
+        surface = program.SDF(position, limit);
+    }
+
+    static void evaluate(const Tape::Program &program, float3 position, float limit, float &surface) {
+        surface = program.distance(position, limit);
+    }
+
+    // Evaluate the previous nearest child first, then only children whose bound undercuts the minimum
+    template <typename V>
+    static V query(Ray &ray, float3 position) {
+        const Set &set = *ray.set;
+        float *keys = ray.keys.data();
+
+        V surface;
+        evaluate(set.programs[ray.nearest], position, std::numeric_limits<float>::infinity(), surface);
+        keys[ray.nearest] = distance(surface) + ray.traveled;
+
+        // Whole lanes of keys are skipped at once, the minimum only shrinks while they are visited
+        size_t evaluated = 1;
+        simd::vfloat traveled = simd::set(ray.traveled);
+        for (size_t first = 0; first < ray.keys.size(); first += simd::lanes) {
+            simd::vfloat bounds = simd::sub(simd::load(keys + first), traveled);
+            if (!simd::any(simd::lt(bounds, simd::set(distance(surface))))) continue;
+
+            for (size_t idx = first; idx < first + simd::lanes; idx++) {
+                if (keys[idx] - ray.traveled >= distance(surface)) continue;
+
+                // Child bounds are checked before the child itself
+                float bound = set.bounds[idx].SDF(position);
+                if (bound >= distance(surface)) {
+                    keys[idx] = bound + ray.traveled;
+                    continue;
+                }
+
+                // Values past the limit still bound the child from below
+                V current;
+                evaluate(set.programs[idx], position, distance(surface), current);
+                keys[idx] = distance(current) + ray.traveled;
+                evaluated++;
+                if (distance(current) < distance(surface)) {
+                    surface = current;
+                    ray.nearest = idx;
+                }
+            }
+        }
+
+        stats::add(stats::CULLED, set.programs.size() - evaluated);
+        return surface;
+    }
+
+    Body::Surface Ray::SDF(float3 position) {
+        return query<Body::Surface>(*this, position);
+    }
+
+    float Ray::distance(float3 position) {
+        return query<float>(*this, position);
+    }
+
+    // Move along the ray, every bound shrinks by the step length in either direction
+    void Ray::advance(float step) {
+        this->traveled += std::abs(step);
+    }
+}
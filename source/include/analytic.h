@@ -0,0 +1,31 @@
+#pragma once
+
+#include <LiteMath.h>
+#include <vector>
+
+#include "body.h"
+#include "tape.h"
+
+using namespace LiteMath;
+
+// Top-level spheres and boxes of a UNION list intersected in closed form instead of being marched
+namespace Analytic {
+    struct Primitive {
+        Body::Type type;    // SPHERE or BOX
+        float3 position;
+        float3 size;        // Sphere radius in every component, box half extents
+        float3 color;
+    };
+
+    struct Set {
+        bool active = false;
+        std::vector<Primitive> primitives;
+
+        void build(Body::List *list);
+        Body::Bounds bounds(void) const;
+        float intersect(float3 origin, float3 ray, float near, float far, size_t &index) const;
+        Body::Surface SDF(float3 position) const;
+        float distance(float3 position) const;
+        Tape::Dual gradient(float3 position) const;
+    };
+}
@@ -12,6 +12,9 @@ namespace Body {
         SPHERE      = 1,
         BOX         = 2,
         CROSS       = 3,
+        MENGER      = 4,
+        REPEAT      = 5,
+        MIRROR      = 6,
     };
 
     enum class Mode : uint {
@@ -26,18 +29,103 @@ namespace Body {
         float3 color;
     };
 
+    // Axis aligned bounding box, every SDF inside is never below Bounds::SDF
+    struct Bounds {
+        float3 lower;
+        float3 upper;
+        float SDF(float3 position) const;
+        static Bounds empty(void);
+        static Bounds infinite(void);
+        static Bounds merge(const Bounds &lbounds, const Bounds &rbounds);
+        static Bounds intersect(const Bounds &lbounds, const Bounds &rbounds);
+        bool clip(float3 origin, float3 ray, float &near, float &far) const;
+    };
+
+    // Whether bodies of the type hold children (List and its transforms)
+    bool composite(Type type);
+
     struct Base : Object::Base {
         Type type;
         Base(Type type);
         virtual Surface SDF(float3 position);
+        virtual Bounds bounds(void);
+        // Bound of the SDF rate of change along the ray over [origin, origin + length * ray]
+        virtual float lipschitz(float3 origin, float3 ray, float length);
+    };
+
+    // Same-type bodies stored as structure of arrays
+    struct Pool {
+        Type type;
+        size_t count;                       // Arrays are padded to simd lanes
+        std::vector<float> x, y, z;         // Positions
+        std::vector<float> sx, sy, sz;      // Half sizes
+        std::vector<float> radius;
+        std::vector<float3> colors;
+        Pool(Type type);
+        void append(Base *body);
+        void pad(void);
+        // Reduction stops once the distance passes limit, an infinite limit of the reduced side never does
+        Surface SDF(float3 position, bool maximum, float limit) const;
+        float distance(float3 position, bool maximum, float limit) const;
+        float nearest(float3 position, bool maximum, float limit, size_t &index) const;   // Distance and index of the reduced body
+        float lipschitz(float3 origin, float3 ray, float length, float limit) const;
     };
 
     struct List : Base {
         std::vector<Base*> bodies;
         Mode mode;
+        Bounds bound;
+
+        // Packed storage: pooled children are evaluated after the loose ones
+        bool packed;
+        std::vector<Base*> loose;
+        std::vector<Pool*> pools;
+
         List(Mode mode = Mode::UNION);
         void append(Base *body);
+        void pack(void);
+        virtual void fit(void);
         Surface SDF(float3 position);
+        virtual Surface SDF(float3 position, float limit);  // Exact below limit, only known to reach it otherwise
+        Bounds bounds(void);
+        float lipschitz(float3 origin, float3 ray, float length);
+        virtual float lipschitz(float3 origin, float3 ray, float length, float limit);  // Children above limit over the segment are skipped
+
+    protected:
+        List(Type type, Mode mode);
+    };
+
+    // Children repeated over a grid of cells, zero count repeats infinitely
+    // Children must fit in one cell centered at the position
+    struct Repeat : List {
+        float3 position;
+        float3 period;
+        int3 count;
+        Repeat(float3 position,
+               float3 period,
+               int3 count = int3(0),
+               Mode mode = Mode::UNION);
+        float3 map(float3 position) const;
+        void fit(void);
+        using List::SDF;
+        Surface SDF(float3 position, float limit);
+        using List::lipschitz;
+        float lipschitz(float3 origin, float3 ray, float length, float limit);
+    };
+
+    // Children on the normal side of the plane reflected to the other side
+    struct Mirror : List {
+        float3 position;
+        float3 normal;
+        Mirror(float3 position,
+               float3 normal,
+               Mode mode = Mode::UNION);
+        float3 map(float3 position) const;
+        void fit(void);
+        using List::SDF;
+        Surface SDF(float3 position, float limit);
+        using List::lipschitz;
+        float lipschitz(float3 origin, float3 ray, float length, float limit);
     };
 
     struct Sphere : Base {
@@ -48,6 +136,8 @@ namespace Body {
                float radius,
                float3 color = float3(1.0f));
         Surface SDF(float3 position);
+        Bounds bounds(void);
+        float lipschitz(float3 origin, float3 ray, float length);
     };
 
     struct Box : Base {
@@ -58,6 +148,8 @@ namespace Body {
             float3 size,
             float3 color = float3(1.0f));
         Surface SDF(float3 position);
+        Bounds bounds(void);
+        float lipschitz(float3 origin, float3 ray, float length);
     };
 
     struct Cross: Base {
@@ -68,9 +160,27 @@ namespace Body {
               float3 size,
               float3 color = float3(1.0f));
         Surface SDF(float3 position);
+        Bounds bounds(void);
+        float lipschitz(float3 origin, float3 ray, float length);
+    };
+
+    // Menger sponge evaluated by domain folding
+    struct Menger : Base {
+        float3 position;
+        float size;
+        int iterations;
+        float3 color;
+        Menger(float3 position,
+               float size,
+               int iterations = 3,
+               float3 color = float3(1.0f));
+        Surface SDF(float3 position);
+        Bounds bounds(void);
+        float lipschitz(float3 origin, float3 ray, float length);
     };
 
     // Generators
+    // Expanded Menger sponge with one Cross per cell, kept for validation
     List* MengerSponge(
             float3 position,
             float size,
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <LiteMath.h>
+#include <cstdint>
+#include <vector>
+
+#include "constants.h"
+#include "body.h"
+#include "tape.h"
+
+using namespace LiteMath;
+
+// Sparse brick map of the scene distance, a cheap lower bound far from the surface
+// A coarse grid covers the geometry, cells near the surface hold a finer brick of samples
+namespace Brick {
+    const int side = constants::brick::resolution + 1;     // Samples per side of a brick
+    const int samples = side * side * side;                 // Samples per brick
+
+    struct Map {
+        bool active = false;
+        float3 lower;                   // Grid corner
+        float cell = 0.0f;              // Coarse cell size
+        int3 cells;                     // Coarse cells per axis
+        std::vector<float> coarse;      // Samples at coarse grid vertices
+        std::vector<int> bricks;        // Brick of every coarse cell, -1 when it has none
+        std::vector<float> fine;        // Samples of every brick, constants::brick::resolution cells per side
+
+        void bake(const Tape::Program &program, const Body::Bounds &bounds);
+        bool load(const char *path, uint64_t key, const Body::Bounds &bounds);
+        void save(const char *path, uint64_t key) const;
+        float distance(float3 position) const;
+    };
+
+    uint64_t key(const Tape::Program &program, const Body::Bounds &bounds);
+}
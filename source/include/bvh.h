@@ -0,0 +1,31 @@
+#pragma once
+
+#include <LiteMath.h>
+#include <vector>
+
+#include "body.h"
+#include "tape.h"
+
+using namespace LiteMath;
+
+// Bounding volume hierarchy over the children of a UNION list
+namespace BVH {
+    struct Node {
+        Body::Bounds bounds;
+        uint first;     // Leaf: first item, inner: right child (left child follows the node)
+        uint count;     // Leaf: amount of items, inner: 0
+    };
+
+    struct Tree {
+        bool active = false;
+        std::vector<Node> nodes;
+        std::vector<uint> items;                // Bounded children in leaf order
+        std::vector<uint> unbounded;            // Children evaluated at every query
+        std::vector<Tape::Program> programs;    // Compiled children
+
+        void build(Body::List *list);
+        Body::Surface SDF(float3 position) const;
+        float distance(float3 position) const;
+        Tape::Dual gradient(float3 position) const;
+    };
+}
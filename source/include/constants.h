@@ -17,13 +17,93 @@ namespace constants {
     const int capacity          = 1 << 10;          // Container::Array capacity
     const int logsize           = 1 << 10;          // Shader log buffer size
 
+    namespace march {
+        const float relaxation  = 1.6f;             // Over-relaxation of sphere tracing steps in relaxed renders
+        const float distance    = 1e4f;             // Rays going further miss
+        const float3 background = float3(0.0f);     // Color of missed rays
+    }
+
+    namespace segment {
+        const float growth      = 2.0f;             // Segment length over the larger of the distance and the previous step
+    }
+
+    namespace cone {
+        const bool enabled      = true;             // Seed primary rays with a cone marching prepass
+        const uint tile         = 8;                // Pixels per side of a prepass tile
+    }
+
+    namespace brick {
+        const bool enabled      = true;             // Bake a brick map of the marched geometry for far field steps
+        const int cells         = 32;               // Coarse cells along the longest axis of the geometry
+        const int resolution    = 4;                // Brick cells per side of a coarse cell
+        const float band        = 1.0f;             // Coarse cells around the surface that get a brick
+        const float tightness   = 0.5f;             // Least ratio of the lower to the upper distance bound to step by it
+        static const char *cache = "binary/bricks"; // Cache file prefix, the scene key follows
+    }
+
+    namespace prune {
+        const int tile          = 64;               // Pixels per side of a root tile of the pruning quadtree
+        const int leaf          = 8;                // Pixels per side of the smallest tile
+    }
+
+    namespace shadow {
+        const float penumbra    = 0.0f;             // Soft shadow sharpness, 0 keeps hard shadows
+    }
+
     namespace precision {
-        const float surface     = 1e-3f;        // Surface hit
+        const float surface     = 1e-3f;        // Surface hit, the least threshold of primary rays
+        const float footprint   = 0.5f;         // Primary ray hit threshold in sample footprints at the hit distance
         const float offset      = 1e-3f;        // Surface offset
     }
 
+    namespace tape {
+        const size_t stackMax   = 1 << 6;           // Amount of values in SDF tape stack
+    }
+
+    namespace shortcut {
+        const bool enabled      = true;             // Stop intersections and differences past their parent limit
+    }
+
+    namespace csg {
+        const bool enabled      = true;             // Simplify the scene tree after loading
+    }
+
+    namespace pool {
+        const size_t threshold  = 8;                // Least amount of same-type bodies to pool
+    }
+
+    namespace bvh {
+        const bool enabled      = true;             // Build BVH over top-level bodies
+        const size_t threshold  = 16;               // Least amount of top-level bodies to build BVH
+        const size_t leafSize   = 2;                // Max amount of bodies in BVH leaf
+        const size_t heapMax    = 1 << 8;           // Amount of pending nodes in BVH query
+    }
+
+    namespace cull {
+        const bool enabled      = true;             // Cull top-level bodies per ray when there is no BVH
+        const size_t threshold  = 16;               // Least amount of top-level bodies to cull
+    }
+
+    namespace analytic {
+        const bool enabled      = true;             // Intersect top-level spheres and boxes in closed form
+        const size_t limit      = 16;               // Most primitives taken, the largest ones go first
+    }
+
     namespace SSAA {
         const int kernel        = 3;                // Kernel size
+        const int kernelMax     = 4;                // Largest kernel size selected at runtime
+        const bool shared       = true;             // Sub-rays of a pixel share one cone march
+        const int samples       = 5;                // Rays per pixel of the patterns besides the grid
+        const int samplesMax    = kernelMax * kernelMax;    // Largest ray count selected at runtime
+        const uint seed         = 0x2545F491;       // Jitter seed, fixed so renders repeat
+        const int reference     = 8;                // Rays per side of the centered lattice of the quality reference
+    }
+
+    // Adaptive SSAA supersamples pixels across an edge with one of their neighbours
+    namespace adaptive {
+        const float color       = 0.1f;             // Largest color channel difference
+        const float depth       = 0.05f;            // Largest depth difference relative to the nearer hit
+        const float normal      = 0.9f;             // Smallest cosine between the normals
     }
 
     namespace stb {
@@ -40,6 +120,8 @@ namespace constants {
         constexpr size_t listEntries    = 1 << 6;   // Number of Lists
         constexpr size_t listMax        = 1 << 10;  // Amount of Nodes List contains
         constexpr size_t stackMax       = 1 << 6;   // Amount of Items in Stack
+        constexpr size_t bvhMax         = 1 << 11;  // Amount of BVH nodes
+        constexpr size_t primitivesMax  = 16;       // Amount of analytic primitives, at least analytic::limit
         constexpr uint lights           = 16;       // Max number of lights in scene
     }
 }
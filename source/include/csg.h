@@ -0,0 +1,13 @@
+#pragma once
+
+#include <LiteMath.h>
+
+#include "body.h"
+
+using namespace LiteMath;
+
+// Rewrites of the scene tree that keep its surface but cut per-step work
+namespace CSG {
+    size_t count(Body::Base *body);
+    void optimize(Body::List *tree);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <LiteMath.h>
+#include <vector>
+
+#include "body.h"
+#include "tape.h"
+
+using namespace LiteMath;
+
+// Per-ray culling over the children of a UNION list
+// Along a ray a child distance shrinks at most by the distance traveled
+namespace Cull {
+    struct Set {
+        bool active = false;
+        std::vector<Tape::Program> programs;    // Compiled children
+        std::vector<Body::Bounds> bounds;       // Child bounds, a cheaper lower bound than the child
+
+        void build(Body::List *list);
+    };
+
+    // Lower bounds of the child distances along one ray
+    struct Ray {
+        const Set *set;
+        std::vector<float> keys;    // Child distance bound plus the distance traveled when it was taken
+        size_t nearest;             // Child of the last minimum, evaluated first
+        float traveled;
+
+        Ray(const Set &set);
+        Body::Surface SDF(float3 position);
+        float distance(float3 position);
+        void advance(float step);
+    };
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <LiteMath.h>
+
+#include "simd.h"
+#include "object.h"
+#include "tape.h"
+
+using namespace LiteMath;
+
+// Scene marching for packets of simd::lanes rays, lanes outside the active mask are ignored
+namespace packet {
+    // Per-lane over-relaxed sphere tracing step, see scene::March
+    struct March {
+        simd::vfloat relaxation;
+        simd::vfloat radius;
+        simd::vfloat length;
+        simd::vmask failed;
+
+        March(float relaxation);
+        simd::vfloat step(simd::vfloat distance);
+    };
+
+    simd::vmask clip(const simd::vfloat3 &position, const simd::vfloat3 &ray, simd::vfloat &near, simd::vfloat &far, float start = 0.0f);
+    Tape::Packet surface(simd::vfloat3 &position, const simd::vfloat3 &ray, simd::vmask active, float start = 0.0f);
+    simd::vfloat occlusion(simd::vfloat3 position, const simd::vfloat3 &ray, simd::vfloat limit, simd::vmask active);
+    simd::vfloat3 raymarch(float3 position, const simd::vfloat3 &ray, simd::vmask active, float start = 0.0f);
+    simd::vfloat shadow(Object::Light *light, simd::vfloat3 position, const simd::vfloat3 &normal, simd::vmask active);
+    simd::vfloat lighting(const simd::vfloat3 &position, const simd::vfloat3 &normal, simd::vmask active);
+    simd::vfloat3 grad(const simd::vfloat3 &position);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <LiteMath.h>
+
+#include "body.h"
+#include "tape.h"
+
+using namespace LiteMath;
+
+// Interval arithmetic over the scene tree, children of unions that can't matter inside a region are dropped
+// A pruned tape is exact for rays that stay inside the region, shadow rays and normals need the whole tree
+namespace Prune {
+    // Distance bounds over every position of a region
+    struct Range {
+        float lower;
+        float upper;
+    };
+
+    Range range(Body::Base *body, const Body::Bounds &region);
+    size_t compile(Body::List *tree, const Body::Bounds &region, float margin, Tape::Program &program);
+    size_t cost(const Tape::Program &program);
+}
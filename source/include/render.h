@@ -1,13 +1,46 @@
 #include <LiteMath.h>
 #include <Image2d.h>
+#include <vector>
 
 using namespace LiteMath;
 using namespace LiteImage;
 
 namespace render {
+    // SSAA sub-ray positions inside the pixel, the grid casts kernel squared rays, the others count rays
+    enum class Pattern {
+        GRID,
+        ROTATED,
+        JITTER,
+        SOBOL,
+        R2,
+    };
+
+    // Selected per render
+    extern int kernel;
+    extern bool shared;
+    extern Pattern pattern;
+    extern int count;
+
     void CPU(Image2D<float4> &image);
-    void OMP(Image2D<float4> &image);
-    void GPU(unsigned char   *image);
+    void OMP(Image2D<float4> &image, const std::vector<float> &depths = std::vector<float>());
+    void Packet(Image2D<float4> &image);
+    void Pruned(Image2D<float4> &image);
+    void Adaptive(Image2D<float4> &image, std::vector<int> &samples);
+    void GPU(unsigned char   *image, bool seeded = false);
+    void GPUAdaptive(unsigned char *image, std::vector<int> &samples);
+
+    // Sample count map of an adaptive render
+    void Samples(const std::vector<int> &samples, Image2D<float4> &image);
+
+    // Quality reference, a centered lattice of constants::SSAA::reference squared rays per pixel
+    void Reference(Image2D<float4> &image);
+
+    // Root mean square error of the colors clamped to the saved range
+    float RMSE(const Image2D<float4> &image, const Image2D<float4> &reference);
+
+    // Cone marching prepass, one start depth per constants::cone::tile sized tile
+    void Prepass(std::vector<float> &depths);
+    void GPUPrepass(void);
 
     /// GPU ///
     namespace setup {
@@ -5,18 +5,64 @@
 #include <vector>
 #include "object.h"
 #include "body.h"
+#include "tape.h"
+#include "bvh.h"
+#include "cull.h"
+#include "analytic.h"
+#include "brick.h"
 
 using namespace LiteMath;
 
 namespace scene {
+    // Over-relaxed sphere tracing step, falls back to plain steps once unbounding spheres stop overlapping
+    struct March {
+        float relaxation;       // Step factor, 1 after the first fallback
+        float radius = 0.0f;    // Unbounding radius at the previous position
+        float length = 0.0f;    // Length of the previous step
+        bool failed = false;    // Previous step overshot and is taken back
+
+        March(float relaxation) : relaxation(relaxation) {}
+        float step(float distance);
+    };
+
+    // Segment tracing step, the largest one the Lipschitz bound of the scene over the next segment allows
+    struct Segment {
+        float length = 0.0f;    // Length of the previous step, the next segment grows from it
+
+        float step(float3 position, float3 ray, float distance);
+    };
+
+    // Step strategy of scene::surface
+    enum class Tracing {
+        SPHERE,
+        SEGMENT,
+    };
+
+    extern Tracing tracing;
+    extern float relaxation;
+    extern float footprint;
     extern Body::List *tree;
+    extern Tape::Program program;
+    extern BVH::Tree bvh;
+    extern Cull::Set cull;
+    extern Analytic::Set analytic;
+    extern Brick::Map bricks;
+    extern Body::Bounds bounds;
     extern std::vector<Object::Light*> lights;
     extern Object::Camera *camera;
-    Body::Surface surface(float3 &position, float3 ray);
-    float3 raymarch(float3 position, float3 ray);
-    bool shadow(Object::Light *light, float3 position, float3 normal);
+    bool clip(float3 position, float3 ray, float &near, float &far, float start = 0.0f);
+    Body::Surface surface(float3 &position, float3 ray, float start = 0.0f, const Tape::Program *tape = nullptr);
+    float occlusion(float3 position, float3 ray, float limit);
+    float cone(float3 position, float3 ray, float slope, float start = 0.0f);
+    float3 raymarch(float3 position, float3 ray, float start = 0.0f);
+    float3 raymarch(float3 position, float3 ray, float start, float &depth, const Tape::Program *tape = nullptr);
+    float3 raymarch(float3 position, float3 ray, float start, float &depth, float3 &normal, const Tape::Program *tape = nullptr);
+    float shadow(Object::Light *light, float3 position, float3 normal);
     float lighting(float3 position, float3 normal);
     Body::Surface SDF(float3 position);
+    float distance(float3 position);
+    Tape::Dual dual(float3 position);
     float3 grad(float3 position);
     void load(const char *path);
+    void bake(void);
 };
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <immintrin.h>
+
+// Thin wrappers over the widest vector unit enabled at compile time
+namespace simd {
+#if defined(__AVX512F__)
+    constexpr int lanes = 16;
+    typedef __m512 vfloat;
+    typedef __mmask16 vmask;
+
+    static inline vfloat load(const float *data)                { return _mm512_loadu_ps(data); }
+    static inline void store(float *data, vfloat a)             { _mm512_storeu_ps(data, a); }
+    static inline vfloat set(float value)                       { return _mm512_set1_ps(value); }
+    static inline vfloat add(vfloat a, vfloat b)                { return _mm512_add_ps(a, b); }
+    static inline vfloat sub(vfloat a, vfloat b)                { return _mm512_sub_ps(a, b); }
+    static inline vfloat mul(vfloat a, vfloat b)                { return _mm512_mul_ps(a, b); }
+    static inline vfloat div(vfloat a, vfloat b)                { return _mm512_div_ps(a, b); }
+    static inline vfloat min(vfloat a, vfloat b)                { return _mm512_min_ps(a, b); }
+    static inline vfloat max(vfloat a, vfloat b)                { return _mm512_max_ps(a, b); }
+    static inline vfloat abs(vfloat a)                          { return _mm512_abs_ps(a); }
+    static inline vfloat sqrt(vfloat a)                         { return _mm512_sqrt_ps(a); }
+    static inline vfloat floor(vfloat a)                        { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+    static inline vmask lt(vfloat a, vfloat b)                  { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static inline vmask gt(vfloat a, vfloat b)                  { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    static inline vfloat select(vmask m, vfloat a, vfloat b)    { return _mm512_mask_blend_ps(m, b, a); }
+    static inline vfloat neg(vfloat a)                          { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x80000000))); }
+    static inline vmask both(vmask a, vmask b)                  { return a & b; }
+    static inline vmask invert(vmask a)                         { return ~a; }
+    static inline bool any(vmask m)                             { return m != 0; }
+    static inline int count(vmask m)                            { return __builtin_popcount(m); }
+#elif defined(__AVX2__)
+    constexpr int lanes = 8;
+    typedef __m256 vfloat;
+    typedef __m256 vmask;
+
+    static inline vfloat load(const float *data)                { return _mm256_loadu_ps(data); }
+    static inline void store(float *data, vfloat a)             { _mm256_storeu_ps(data, a); }
+    static inline vfloat set(float value)                       { return _mm256_set1_ps(value); }
+    static inline vfloat add(vfloat a, vfloat b)                { return _mm256_add_ps(a, b); }
+    static inline vfloat sub(vfloat a, vfloat b)                { return _mm256_sub_ps(a, b); }
+    static inline vfloat mul(vfloat a, vfloat b)                { return _mm256_mul_ps(a, b); }
+    static inline vfloat div(vfloat a, vfloat b)                { return _mm256_div_ps(a, b); }
+    static inline vfloat min(vfloat a, vfloat b)                { return _mm256_min_ps(a, b); }
+    static inline vfloat max(vfloat a, vfloat b)                { return _mm256_max_ps(a, b); }
+    static inline vfloat abs(vfloat a)                          { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static inline vfloat sqrt(vfloat a)                         { return _mm256_sqrt_ps(a); }
+    static inline vfloat floor(vfloat a)                        { return _mm256_floor_ps(a); }
+    static inline vmask lt(vfloat a, vfloat b)                  { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static inline vmask gt(vfloat a, vfloat b)                  { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static inline vfloat select(vmask m, vfloat a, vfloat b)    { return _mm256_blendv_ps(b, a, m); }
+    static inline vfloat neg(vfloat a)                          { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+    static inline vmask both(vmask a, vmask b)                  { return _mm256_and_ps(a, b); }
+    static inline vmask invert(vmask a)                         { return _mm256_xor_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(-1))); }
+    static inline bool any(vmask m)                             { return _mm256_movemask_ps(m) != 0; }
+    static inline int count(vmask m)                            { return __builtin_popcount(_mm256_movemask_ps(m)); }
+#else
+    constexpr int lanes = 1;
+    typedef float vfloat;
+    typedef bool vmask;
+
+    static inline vfloat load(const float *data)                { return *data; }
+    static inline void store(float *data, vfloat a)             { *data = a; }
+    static inline vfloat set(float value)                       { return value; }
+    static inline vfloat add(vfloat a, vfloat b)                { return a + b; }
+    static inline vfloat sub(vfloat a, vfloat b)                { return a - b; }
+    static inline vfloat mul(vfloat a, vfloat b)                { return a * b; }
+    static inline vfloat div(vfloat a, vfloat b)                { return a / b; }
+    static inline vfloat min(vfloat a, vfloat b)                { return a < b ? a : b; }
+    static inline vfloat max(vfloat a, vfloat b)                { return a > b ? a : b; }
+    static inline vfloat abs(vfloat a)                          { return a < 0.0f ? -a : a; }
+    static inline vfloat sqrt(vfloat a)                         { return __builtin_sqrtf(a); }
+    static inline vfloat floor(vfloat a)                        { return __builtin_floorf(a); }
+    static inline vmask lt(vfloat a, vfloat b)                  { return a < b; }
+    static inline vmask gt(vfloat a, vfloat b)                  { return a > b; }
+    static inline vfloat select(vmask m, vfloat a, vfloat b)    { return m ? a : b; }
+    static inline vfloat neg(vfloat a)                          { return -a; }
+    static inline vmask both(vmask a, vmask b)                  { return a && b; }
+    static inline vmask invert(vmask a)                         { return !a; }
+    static inline bool any(vmask m)                             { return m; }
+    static inline int count(vmask m)                            { return m ? 1 : 0; }
+#endif
+
+    // One float3 per lane
+    struct vfloat3 {
+        vfloat x, y, z;
+    };
+
+    static inline vfloat3 set(float x, float y, float z)           { return { set(x), set(y), set(z) }; }
+    static inline vfloat3 add(const vfloat3 &a, const vfloat3 &b)   { return { add(a.x, b.x), add(a.y, b.y), add(a.z, b.z) }; }
+    static inline vfloat3 sub(const vfloat3 &a, const vfloat3 &b)   { return { sub(a.x, b.x), sub(a.y, b.y), sub(a.z, b.z) }; }
+    static inline vfloat3 mul(const vfloat3 &a, vfloat b)           { return { mul(a.x, b), mul(a.y, b), mul(a.z, b) }; }
+    static inline vfloat3 abs(const vfloat3 &a)                     { return { abs(a.x), abs(a.y), abs(a.z) }; }
+    static inline vfloat3 neg(const vfloat3 &a)                     { return { neg(a.x), neg(a.y), neg(a.z) }; }
+    static inline vfloat dot(const vfloat3 &a, const vfloat3 &b)    { return add(add(mul(a.x, b.x), mul(a.y, b.y)), mul(a.z, b.z)); }
+    static inline vfloat length(const vfloat3 &a)                   { return sqrt(dot(a, a)); }
+    static inline vfloat3 normalize(const vfloat3 &a)               { return mul(a, div(set(1.0f), length(a))); }
+    static inline vfloat3 select(vmask m, const vfloat3 &a, const vfloat3 &b) {
+        return { select(m, a.x, b.x), select(m, a.y, b.y), select(m, a.z, b.z) };
+    }
+}
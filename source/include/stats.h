@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+// Evaluation counters gathered by every render thread
+namespace stats {
+    // Must be in sync with glsl compute shader counters
+    enum Counter : size_t {
+        EXITS       = 0,    // Lists left early at the limit given by their parent
+        SKIPPED     = 1,    // Children not evaluated by those exits
+        CULLED      = 2,    // Child evaluations avoided by per-ray bounds
+        RAYS        = 3,    // Rays marched
+        ITERATIONS  = 4,    // Marching iterations of those rays
+        PIXELS      = 5,    // Pixels rendered
+        CONES       = 6,    // Cone marching iterations
+        LOOKUPS     = 7,    // Marching iterations stepped by the brick map
+        COUNTERS    = 8,
+    };
+
+    void add(Counter counter, size_t amount = 1);
+    size_t total(Counter counter);
+    void reset(void);
+    void report(const char *name);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <LiteMath.h>
+#include <limits>
+#include <vector>
+#include "constants.h"
+#include "simd.h"
+#include "body.h"
+
+using namespace LiteMath;
+
+// Flat post-order form of the Body tree evaluated without virtual calls
+namespace Tape {
+    enum class Op : uint {
+        SPHERE      = 0,
+        BOX         = 1,
+        CROSS       = 2,
+        EMPTY       = 3,    // Empty list
+        NEGATE      = 4,    // Complement the top value
+        MERGE       = 5,    // Pop the top value
+        POOL        = 6,    // Reduce a pool of same-type bodies
+        BOUND       = 7,    // Skip the next list if its bounds can't change the top value
+        MENGER      = 8,
+        REPEAT      = 9,    // Save the position and move it into the repeat cell
+        MIRROR      = 10,   // Save the position and reflect it to the normal side
+        LEAVE       = 11,   // Restore the saved position
+        LIMIT       = 12,   // Set the limit of the next stack slot from the top value and its limit
+        EXIT        = 13,   // Skip the rest of the list once the top value reaches its limit
+    };
+
+    // How the result of an instruction joins the stack
+    enum class Fold : uint {
+        PUSH            = 0,
+        UNION           = 1,
+        COMPLEMENT      = 2,
+        INTERSECTION    = 3,
+        DIFFERENCE      = 4,
+    };
+
+    struct Instruction {
+        Op op;
+        Fold fold;
+        uint material;      // Index in Program::materials, pools take the following ones too
+        float3 position;    // Bounds lower corner
+        float3 size;        // Sphere radius in size.x, Menger size and iterations in size.xy, bounds upper corner,
+                            // repeat period, mirror normal
+        float3 count;       // Repeat count, children left behind an exit in count.x
+        const Body::Pool *pool;
+        size_t skip;        // Instructions covered by bounds or by an exit
+    };
+
+    // Surfaces of every lane in a ray packet
+    struct Packet {
+        simd::vfloat SD;
+        simd::vfloat3 color;
+    };
+
+    // Distance with its gradient taken in the same pass
+    struct Dual {
+        float SD;
+        float3 grad;
+    };
+
+    struct Duals {
+        simd::vfloat SD;
+        simd::vfloat3 grad;
+    };
+
+    // Distances carry the material of the winning body, colors are looked up once at the end
+    // Scalar queries are exact below limit and only known to reach it otherwise
+    struct Program {
+        std::vector<Instruction> code;
+        std::vector<float3> materials;  // Colors of the bodies, the first one is for empty lists
+        size_t depth = 0;   // Stack depth required by the code
+        size_t frames = 0;  // Saved positions required by the code
+        Body::Base *tree = nullptr;     // Evaluated instead when the code is too deep for the interpreter
+        Body::Surface SDF(float3 position, float limit = std::numeric_limits<float>::infinity()) const;
+        Packet SDF(const simd::vfloat3 &position) const;
+        float distance(float3 position, float limit = std::numeric_limits<float>::infinity()) const;
+        simd::vfloat distance(const simd::vfloat3 &position) const;
+        Dual gradient(float3 position, float limit = std::numeric_limits<float>::infinity()) const;
+        Duals gradient(const simd::vfloat3 &position) const;
+    };
+
+    void compile(Body::Base *tree, Program &program);
+}
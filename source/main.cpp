@@ -5,9 +5,16 @@
 
 // Test runtime
 #include <chrono>
+#include <cmath>
 #include <iostream>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "constants.h"
+#include "simd.h"
+#include "stats.h"
 #include "scene.h"
 #include "render.h"
 
@@ -16,6 +23,8 @@ using namespace LiteImage;
 
 int main() {
     Image2D<float4> CPUimage(constants::width, constants::height);
+    Image2D<float4> samplesImage(constants::width, constants::height);
+    std::vector<int> samples;
 
     // Load scene
     std::cout << "...Loading scene" << std::endl;
@@ -36,11 +45,13 @@ int main() {
     std::chrono::time_point<std::chrono::system_clock> start, end;
     std::chrono::duration<double> duration;
 
+    stats::reset();
     start = std::chrono::system_clock::now();
     render::CPU(CPUimage);
     end = std::chrono::system_clock::now();
     duration = end - start;
     std::cout << "Render with CPU (1 thread):\t" << duration.count() << "s" << std::endl;
+    stats::report("CPU");
 
     // OpenMP
     start = std::chrono::system_clock::now();
@@ -48,6 +59,157 @@ int main() {
     end = std::chrono::system_clock::now();
     duration = end - start;
     std::cout << "Render with OpenMP (4 threads):\t" << duration.count() << "s" << std::endl;
+    stats::report("OpenMP");
+
+    // OpenMP with the fixed hit threshold
+    float footprint = scene::footprint;
+    scene::footprint = 0.0f;
+    start = std::chrono::system_clock::now();
+    render::OMP(CPUimage);
+    end = std::chrono::system_clock::now();
+    duration = end - start;
+    scene::footprint = footprint;
+    std::cout << "Render with OpenMP fixed hits:\t" << duration.count() << "s" << std::endl;
+    stats::report("fixed hits");
+
+    // OpenMP with over-relaxed sphere tracing
+    scene::relaxation = constants::march::relaxation;
+    start = std::chrono::system_clock::now();
+    render::OMP(CPUimage);
+    end = std::chrono::system_clock::now();
+    duration = end - start;
+    scene::relaxation = 1.0f;
+    std::cout << "Render with OpenMP relaxed:\t" << duration.count() << "s" << std::endl;
+    stats::report("relaxed");
+
+    // OpenMP with segment tracing
+    scene::tracing = scene::Tracing::SEGMENT;
+    start = std::chrono::system_clock::now();
+    render::OMP(CPUimage);
+    end = std::chrono::system_clock::now();
+    duration = end - start;
+    scene::tracing = scene::Tracing::SPHERE;
+    std::cout << "Render with OpenMP segments:\t" << duration.count() << "s" << std::endl;
+    stats::report("segments");
+
+    // OpenMP seeded by the cone prepass
+    if (constants::cone::enabled) {
+        std::vector<float> depths;
+        std::chrono::duration<double> prepassDuration;
+        start = std::chrono::system_clock::now();
+        render::Prepass(depths);
+        end = std::chrono::system_clock::now();
+        prepassDuration = end - start;
+        std::cout << "Cone prepass with OpenMP:\t" << prepassDuration.count() << "s" << std::endl;
+
+        start = std::chrono::system_clock::now();
+        render::OMP(CPUimage, depths);
+        end = std::chrono::system_clock::now();
+        duration = end - start;
+        std::cout << "Render with OpenMP seeded:\t" << duration.count() << "s" << std::endl;
+        duration += prepassDuration;
+        std::cout << "Prepass + seeded render:\t" << duration.count() << "s" << std::endl;
+        stats::report("seeded");
+    }
+
+    // OpenMP stepping far from the geometry by a baked brick map
+    if (constants::brick::enabled) {
+        std::chrono::duration<double> bakeDuration;
+        start = std::chrono::system_clock::now();
+        scene::bake();
+        end = std::chrono::system_clock::now();
+        bakeDuration = end - start;
+        std::cout << "Brick map with OpenMP:\t\t" << bakeDuration.count() << "s" << std::endl;
+
+        start = std::chrono::system_clock::now();
+        render::OMP(CPUimage);
+        end = std::chrono::system_clock::now();
+        duration = end - start;
+        scene::bricks.active = false;
+        std::cout << "Render with OpenMP bricks:\t" << duration.count() << "s" << std::endl;
+        stats::report("bricks");
+    }
+
+    // OpenMP over a quadtree of tiles with tapes pruned to them
+    start = std::chrono::system_clock::now();
+    render::Pruned(CPUimage);
+    end = std::chrono::system_clock::now();
+    duration = end - start;
+    std::cout << "Render with OpenMP pruned:\t" << duration.count() << "s" << std::endl;
+    stats::report("pruned");
+
+    // OpenMP at several SSAA kernels with and without the shared pixel cone
+    for (int kernel = 2; kernel <= constants::SSAA::kernelMax; kernel++) {
+        for (bool shared : { false, true }) {
+            render::kernel = kernel;
+            render::shared = shared;
+            start = std::chrono::system_clock::now();
+            render::OMP(CPUimage);
+            end = std::chrono::system_clock::now();
+            duration = end - start;
+            std::string name = "kernel " + std::to_string(kernel) + (shared ? " shared" : "");
+            std::cout << "Render with OpenMP (" << name << "):\t" << duration.count() << "s" << std::endl;
+            stats::report(name.c_str());
+        }
+    }
+    render::kernel = constants::SSAA::kernel;
+    render::shared = constants::SSAA::shared;
+
+    // OpenMP supersampling only the pixels across an edge, up to the largest kernel
+    render::kernel = constants::SSAA::kernelMax;
+    start = std::chrono::system_clock::now();
+    render::Adaptive(CPUimage, samples);
+    end = std::chrono::system_clock::now();
+    duration = end - start;
+    render::kernel = constants::SSAA::kernel;
+    std::cout << "Render with OpenMP adaptive:\t" << duration.count() << "s" << std::endl;
+    std::cout << "Samples per pixel (adaptive):\t"
+              << double(std::accumulate(samples.begin(), samples.end(), 0)) / samples.size() << std::endl;
+    stats::report("adaptive");
+
+    // Save sample count map
+    render::Samples(samples, samplesImage);
+    SaveImage("out_samples_cpu.png", samplesImage, 1.0f);
+
+    // Error of every sample pattern against a centered high-sample reference over a range of ray counts,
+    // the grid only takes square counts
+    Image2D<float4> reference(constants::width, constants::height);
+    render::Reference(reference);
+    std::vector<std::pair<render::Pattern, std::string>> patterns = {
+        { render::Pattern::GRID, "grid" },
+        { render::Pattern::ROTATED, "rotated" },
+        { render::Pattern::JITTER, "jitter" },
+        { render::Pattern::SOBOL, "Sobol" },
+        { render::Pattern::R2, "R2" },
+    };
+    for (const auto &pattern : patterns) {
+        render::pattern = pattern.first;
+        for (int count = 1; count <= constants::SSAA::kernel * constants::SSAA::kernel; count++) {
+            render::kernel = int(std::sqrt(float(count)));
+            render::count = count;
+            if (pattern.first == render::Pattern::GRID && render::kernel * render::kernel != count) continue;
+
+            start = std::chrono::system_clock::now();
+            render::OMP(CPUimage);
+            end = std::chrono::system_clock::now();
+            duration = end - start;
+            float error = render::RMSE(CPUimage, reference);
+            std::cout << "Quality (" << pattern.second << ", " << count << " rays):\tRMSE " << error
+                      << ", PSNR " << -20.0f * std::log10(error) << " dB, " << duration.count() << "s" << std::endl;
+        }
+    }
+    render::pattern = render::Pattern::GRID;
+    render::kernel = constants::SSAA::kernel;
+    render::count = constants::SSAA::samples;
+    stats::reset();
+
+    // OpenMP with ray packets
+    start = std::chrono::system_clock::now();
+    render::Packet(CPUimage);
+    end = std::chrono::system_clock::now();
+    duration = end - start;
+    std::cout << "Render with packets (" << simd::lanes << " rays):\t" << duration.count() << "s" << std::endl;
+    stats::report("packets");
 
     // Save CPU image
     SaveImage("out_cpu.png", CPUimage, constants::gamma);
@@ -71,6 +233,76 @@ int main() {
     duration = end - start;
 
     std::cout << "Render with GPU:\t\t" << duration.count() << "s" << std::endl;
+    stats::report("GPU");
+
+    // Render with GPU using over-relaxed sphere tracing
+    std::chrono::duration<double> relaxedDuration;
+    scene::relaxation = constants::march::relaxation;
+    start = std::chrono::system_clock::now();
+    render::GPU(GPUimage);
+    end = std::chrono::system_clock::now();
+    relaxedDuration = end - start;
+    scene::relaxation = 1.0f;
+    std::cout << "Render with GPU relaxed:\t" << relaxedDuration.count() << "s" << std::endl;
+    stats::report("GPU relaxed");
+
+    // Render with GPU using segment tracing
+    std::chrono::duration<double> segmentDuration;
+    scene::tracing = scene::Tracing::SEGMENT;
+    start = std::chrono::system_clock::now();
+    render::GPU(GPUimage);
+    end = std::chrono::system_clock::now();
+    segmentDuration = end - start;
+    scene::tracing = scene::Tracing::SPHERE;
+    std::cout << "Render with GPU segments:\t" << segmentDuration.count() << "s" << std::endl;
+    stats::report("GPU segments");
+
+    // Render with GPU seeded by the cone prepass dispatch
+    if (constants::cone::enabled) {
+        std::chrono::duration<double> prepassDuration, seededDuration;
+        start = std::chrono::system_clock::now();
+        render::GPUPrepass();
+        end = std::chrono::system_clock::now();
+        prepassDuration = end - start;
+        std::cout << "Cone prepass with GPU:\t\t" << prepassDuration.count() << "s" << std::endl;
+
+        start = std::chrono::system_clock::now();
+        render::GPU(GPUimage, true);
+        end = std::chrono::system_clock::now();
+        seededDuration = end - start;
+        std::cout << "Render with GPU seeded:\t\t" << seededDuration.count() << "s" << std::endl;
+        seededDuration += prepassDuration;
+        std::cout << "Prepass + seeded render:\t" << seededDuration.count() << "s" << std::endl;
+        stats::report("GPU seeded");
+    }
+
+    // Render with GPU on the rotated grid at fewer rays
+    std::chrono::duration<double> rotatedDuration;
+    render::pattern = render::Pattern::ROTATED;
+    start = std::chrono::system_clock::now();
+    render::GPU(GPUimage);
+    end = std::chrono::system_clock::now();
+    rotatedDuration = end - start;
+    render::pattern = render::Pattern::GRID;
+    std::cout << "Render with GPU rotated (" << render::count << " rays):\t" << rotatedDuration.count() << "s" << std::endl;
+    stats::report("GPU rotated");
+
+    // Render with GPU supersampling only the pixels across an edge
+    std::chrono::duration<double> adaptiveDuration;
+    render::kernel = constants::SSAA::kernelMax;
+    start = std::chrono::system_clock::now();
+    render::GPUAdaptive(GPUimage, samples);
+    end = std::chrono::system_clock::now();
+    adaptiveDuration = end - start;
+    render::kernel = constants::SSAA::kernel;
+    std::cout << "Render with GPU adaptive:\t" << adaptiveDuration.count() << "s" << std::endl;
+    std::cout << "Samples per pixel (GPU adaptive):\t"
+              << double(std::accumulate(samples.begin(), samples.end(), 0)) / samples.size() << std::endl;
+    stats::report("GPU adaptive");
+
+    render::Samples(samples, samplesImage);
+    SaveImage("out_samples_gpu.png", samplesImage, 1.0f);
+
     std::cout << "Copy to GPU:\t\t\t" << pushDuration.count() << "s" << std::endl;
 
     duration += pushDuration;
@@ -0,0 +1,245 @@
+#include <LiteMath.h>
+#include <cmath>
+#include <limits>
+
+#include "constants.h"
+#include "simd.h"
+#include "object.h"
+#include "tape.h"
+#include "stats.h"
+#include "scene.h"
+#include "packet.h"
+
+using namespace LiteMath;
+
+// Calculate the colors produced by rays, the rays are known to be empty up to start
+simd::vfloat3 packet::raymarch(float3 origin, const simd::vfloat3 &ray, simd::vmask active, float start) {
+    simd::vfloat3 position = simd::set(origin.x, origin.y, origin.z);
+    Tape::Packet surface = packet::surface(position, ray, active, start);
+    simd::vmask hit = simd::both(active, simd::lt(surface.SD, simd::set(std::numeric_limits<float>::infinity())));
+    simd::vfloat3 normal = simd::normalize(packet::grad(position));
+    simd::vfloat light = packet::lighting(position, normal, hit);
+    float3 background = constants::march::background;
+    return simd::select(hit, simd::mul(surface.color, light), simd::set(background.x, background.y, background.z));
+}
+
+// Span of the rays past start inside the scene bounds, returns lanes that reach them
+simd::vmask packet::clip(const simd::vfloat3 &position, const simd::vfloat3 &ray, simd::vfloat &near, simd::vfloat &far, float start) {
+    const Body::Bounds &bounds = scene::bounds;
+    const float lower[3] = { bounds.lower.x, bounds.lower.y, bounds.lower.z };
+    const float upper[3] = { bounds.upper.x, bounds.upper.y, bounds.upper.z };
+    const simd::vfloat origins[3] = { position.x, position.y, position.z };
+    const simd::vfloat directions[3] = { ray.x, ray.y, ray.z };
+
+    near = simd::set(start);
+    far = simd::set(constants::march::distance);
+    for (int axis = 0; axis < 3; axis++) {
+        simd::vfloat inverse = simd::div(simd::set(1.0f), directions[axis]);
+        simd::vfloat enter = simd::mul(simd::sub(simd::set(lower[axis]), origins[axis]), inverse);
+        simd::vfloat leave = simd::mul(simd::sub(simd::set(upper[axis]), origins[axis]), inverse);
+        near = simd::max(near, simd::min(enter, leave));
+        far = simd::min(far, simd::max(enter, leave));
+    }
+    return simd::invert(simd::gt(near, far));
+}
+
+// Closest analytic hits inside [near, far] per lane, infinity where the lane misses or is inactive
+static simd::vfloat analytic(const simd::vfloat3 &position, const simd::vfloat3 &ray,
+                             simd::vfloat near, simd::vfloat far, simd::vmask active, simd::vfloat3 &color) {
+    float infinity = std::numeric_limits<float>::infinity();
+    if (!scene::analytic.active) return simd::set(infinity);
+
+    float origins[3][simd::lanes], directions[3][simd::lanes], colors[3][simd::lanes];
+    float nears[simd::lanes], fars[simd::lanes], hits[simd::lanes];
+    simd::store(origins[0], position.x); simd::store(origins[1], position.y); simd::store(origins[2], position.z);
+    simd::store(directions[0], ray.x); simd::store(directions[1], ray.y); simd::store(directions[2], ray.z);
+    simd::store(nears, near);
+    simd::store(fars, simd::select(active, far, simd::set(-infinity)));
+    for (int lane = 0; lane < simd::lanes; lane++) {
+        float3 origin = float3(origins[0][lane], origins[1][lane], origins[2][lane]);
+        float3 direction = float3(directions[0][lane], directions[1][lane], directions[2][lane]);
+        size_t index = 0;
+        hits[lane] = scene::analytic.intersect(origin, direction, nears[lane], fars[lane], index);
+        float3 hue = std::isinf(hits[lane]) ? float3(0.0f) : scene::analytic.primitives[index].color;
+        colors[0][lane] = hue.x; colors[1][lane] = hue.y; colors[2][lane] = hue.z;
+    }
+    color = { simd::load(colors[0]), simd::load(colors[1]), simd::load(colors[2]) };
+    return simd::load(hits);
+}
+
+// Distance to the closest analytic primitive per lane
+static simd::vfloat primitives(const simd::vfloat3 &position) {
+    float x[simd::lanes], y[simd::lanes], z[simd::lanes], distances[simd::lanes];
+    simd::store(x, position.x); simd::store(y, position.y); simd::store(z, position.z);
+    for (int lane = 0; lane < simd::lanes; lane++)
+        distances[lane] = scene::analytic.distance(float3(x[lane], y[lane], z[lane]));
+    return simd::load(distances);
+}
+
+packet::March::March(float relaxation) {
+    this->relaxation = simd::set(relaxation);
+    this->radius = simd::set(0.0f);
+    this->length = simd::set(0.0f);
+    this->failed = simd::lt(this->radius, this->radius);
+}
+
+// Next step lengths along the rays, lanes fall back to plain steps independently
+simd::vfloat packet::March::step(simd::vfloat distance) {
+    simd::vfloat one = simd::set(1.0f);
+    simd::vfloat radius = simd::abs(distance);
+    this->failed = simd::both(simd::gt(this->relaxation, one),
+                              simd::lt(simd::add(radius, this->radius), this->length));
+    this->length = simd::select(this->failed,
+                                simd::sub(this->length, simd::mul(this->relaxation, this->length)),
+                                simd::mul(this->relaxation, distance));
+    this->relaxation = simd::select(this->failed, one, this->relaxation);
+    this->radius = radius;
+    return this->length;
+}
+
+// Lanes retire independently once they hit the surface, misses come back with an infinite distance
+Tape::Packet packet::surface(simd::vfloat3 &position, const simd::vfloat3 &ray, simd::vmask active, float start) {
+    float3 background = constants::march::background;
+    simd::vfloat infinity = simd::set(std::numeric_limits<float>::infinity());
+    Tape::Packet surface = { .SD = infinity, .color = simd::set(background.x, background.y, background.z) };
+    simd::vfloat least = simd::set(constants::precision::surface);
+    simd::vfloat footprint = simd::set(scene::footprint);
+    simd::vfloat zero = simd::set(0.0f);
+    March march(scene::relaxation);
+    size_t iterations = 0;
+
+    stats::add(stats::RAYS, simd::count(active));
+    simd::vfloat near, far;
+    active = simd::both(active, packet::clip(position, ray, near, far, start));
+
+    // The closest analytic hit ends the march of the remaining geometry
+    simd::vfloat3 origin = position, hitColor;
+    simd::vfloat hit = analytic(origin, ray, near, far, active, hitColor);
+    far = simd::min(far, hit);
+    simd::vmask bounded = simd::invert(simd::gt(hit, far));
+
+    simd::vfloat traveled = simd::select(active, near, zero);
+    position = simd::add(position, simd::mul(ray, traveled));
+
+    for (int _ = 0; _ < constants::iterations && simd::any(active); _++) {
+        iterations += simd::count(active);
+        Tape::Packet current = scene::program.SDF(position);
+        simd::vfloat precision = simd::max(least, simd::mul(footprint, traveled));
+        simd::vfloat reach = simd::add(traveled, current.SD);
+        simd::vfloat step = simd::select(active, march.step(current.SD), zero);
+        position = simd::add(position, simd::mul(ray, step));
+        traveled = simd::add(traveled, step);
+        surface.SD = simd::select(active, current.SD, surface.SD);
+        surface.color = simd::select(active, current.color, surface.color);
+
+        simd::vmask valid = simd::both(active, simd::invert(march.failed));
+        simd::vmask touched = simd::both(valid, simd::lt(current.SD, precision));
+        simd::vmask missed = simd::both(simd::both(valid, simd::invert(touched)), simd::gt(reach, far));
+        simd::vmask blocked = simd::both(missed, bounded);
+        surface.SD = simd::select(missed, infinity, surface.SD);
+        surface.color = simd::select(missed, simd::set(background.x, background.y, background.z), surface.color);
+        surface.SD = simd::select(blocked, zero, surface.SD);
+        surface.color = simd::select(blocked, hitColor, surface.color);
+        position = simd::select(blocked, simd::add(origin, simd::mul(ray, hit)), position);
+        active = simd::both(active, simd::invert(touched));
+        active = simd::both(active, simd::invert(missed));
+    }
+    stats::add(stats::ITERATIONS, iterations);
+    return surface;
+}
+
+// Fraction of the light passing along the rays up to limit, lanes turn 0 once a surface blocks them
+simd::vfloat packet::occlusion(simd::vfloat3 position, const simd::vfloat3 &ray, simd::vfloat limit, simd::vmask active) {
+    simd::vfloat precision = simd::set(constants::precision::surface);
+    simd::vfloat penumbra = simd::set(constants::shadow::penumbra);
+    simd::vfloat zero = simd::set(0.0f);
+    simd::vfloat light = simd::set(1.0f);
+    March march(scene::relaxation);
+    size_t iterations = 0;
+
+    stats::add(stats::RAYS, simd::count(active));
+    simd::vfloat near, far;
+    active = simd::both(active, packet::clip(position, ray, near, far));
+    far = simd::min(far, limit);
+
+    // Any analytic hit blocks the light, with a penumbra primitives are marched with the tree to soften it
+    bool soft = constants::shadow::penumbra > 0.0f && scene::analytic.active;
+    if (!soft) {
+        simd::vfloat3 color;
+        simd::vmask blocked = simd::both(active, simd::invert(simd::gt(analytic(position, ray, near, far, active, color), far)));
+        light = simd::select(blocked, zero, light);
+        active = simd::both(active, simd::invert(blocked));
+    }
+
+    simd::vfloat traveled = simd::select(active, near, zero);
+    position = simd::add(position, simd::mul(ray, traveled));
+
+    for (int _ = 0; _ < constants::iterations && simd::any(active); _++) {
+        iterations += simd::count(active);
+        simd::vfloat distance = scene::program.distance(position);
+        if (soft) distance = simd::min(distance, primitives(position));
+        simd::vfloat reach = simd::add(traveled, distance);
+        simd::vfloat step = simd::select(active, march.step(distance), zero);
+
+        simd::vmask valid = simd::both(active, simd::invert(march.failed));
+        simd::vmask hit = simd::both(valid, simd::lt(distance, precision));
+        if (constants::shadow::penumbra > 0.0f) {
+            simd::vfloat ratio = simd::mul(penumbra, simd::div(distance, traveled));
+            light = simd::select(simd::both(valid, simd::gt(traveled, zero)), simd::min(light, ratio), light);
+        }
+        simd::vmask missed = simd::both(simd::both(valid, simd::invert(hit)), simd::gt(reach, far));
+        light = simd::select(hit, zero, light);
+        active = simd::both(active, simd::invert(hit));
+        active = simd::both(active, simd::invert(missed));
+
+        position = simd::add(position, simd::mul(ray, step));
+        traveled = simd::add(traveled, step);
+    }
+    stats::add(stats::ITERATIONS, iterations);
+
+    // Lanes still marching after the last iteration count as blocked
+    return simd::select(active, zero, light);
+}
+
+// Fraction of the light reaching the surfaces, 0 in full shadow
+simd::vfloat packet::shadow(Object::Light *light, simd::vfloat3 position, const simd::vfloat3 &normal, simd::vmask active) {
+    simd::vfloat3 target = simd::set(light->position.x, light->position.y, light->position.z);
+    simd::vfloat offset = simd::set(constants::precision::surface + constants::precision::offset);
+    position = simd::add(position, simd::mul(normal, offset));
+    simd::vfloat3 direction = simd::sub(target, position);
+    return packet::occlusion(position, simd::normalize(direction), simd::length(direction), active);
+}
+
+// Calculate the lighting at the surfaces
+simd::vfloat packet::lighting(const simd::vfloat3 &position, const simd::vfloat3 &normal, simd::vmask active) {
+    simd::vfloat lighting = simd::set(0.0f);
+    for (uint idx = 0; idx < scene::lights.size(); idx++) {
+        Object::Light *light = scene::lights[idx];
+        simd::vfloat visible = packet::shadow(light, position, normal, active);
+
+        simd::vfloat3 target = simd::set(light->position.x, light->position.y, light->position.z);
+        simd::vfloat diffuse = simd::dot(normal, simd::normalize(simd::sub(target, position)));
+        simd::vmask lit = simd::gt(visible, simd::set(0.0f));
+        lighting = simd::add(lighting, simd::select(lit, simd::mul(visible, diffuse), simd::set(0.0f)));
+    }
+    lighting = simd::max(lighting, simd::set(constants::saturation));
+    lighting = simd::min(lighting, simd::set(1.0f));
+    return lighting;
+}
+
+// Calculate gradient of scene SDF, analytic primitives are compared per lane
+simd::vfloat3 packet::grad(const simd::vfloat3 &p) {
+    Tape::Duals dual = scene::program.gradient(p);
+    if (!scene::analytic.active) return dual.grad;
+
+    float positions[3][simd::lanes], grads[3][simd::lanes], distances[simd::lanes];
+    simd::store(positions[0], p.x); simd::store(positions[1], p.y); simd::store(positions[2], p.z);
+    simd::store(grads[0], dual.grad.x); simd::store(grads[1], dual.grad.y); simd::store(grads[2], dual.grad.z);
+    simd::store(distances, dual.SD);
+    for (int lane = 0; lane < simd::lanes; lane++) {
+        Tape::Dual primitive = scene::analytic.gradient(float3(positions[0][lane], positions[1][lane], positions[2][lane]));
+        if (primitive.SD >= distances[lane]) continue;
+        grads[0][lane] = primitive.grad.x; grads[1][lane] = primitive.grad.y; grads[2][lane] = primitive.grad.z;
+    }
+    return { simd::load(grads[0]), simd::load(grads[1]), simd::load(grads[2]) };
+}
@@ -0,0 +1,231 @@
+#include <LiteMath.h>
+#include <cmath>
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <map>
+#include <vector>
+
+#include "constants.h"
+#include "body.h"
+#include "tape.h"
+#include "prune.h"
+
+using namespace LiteMath;
+
+namespace Prune {
+    static const float infinity = std::numeric_limits<float>::infinity();
+
+    /// Interval arithmetic ///
+    static Range negate(const Range &range) {
+        return { .lower = -range.upper, .upper = -range.lower };
+    }
+
+    // Folds mirror List::SDF
+    static Range apply(Body::Mode mode, const Range &surface, const Range &current) {
+        switch (mode) {
+            case Body::Mode::UNION:
+                return { .lower = std::min(surface.lower, current.lower), .upper = std::min(surface.upper, current.upper) };
+
+            case Body::Mode::COMPLEMENT:
+                return apply(Body::Mode::UNION, surface, negate(current));
+
+            case Body::Mode::INTERSECTION:
+                return { .lower = std::max(surface.lower, current.lower), .upper = std::max(surface.upper, current.upper) };
+
+            case Body::Mode::DIFFERENCE:
+                return apply(Body::Mode::INTERSECTION, surface, negate(current));
+
+            default: break;
+        }
+        return surface;
+    }
+
+    // Range of the offset from center along the axis, less the half size
+    static Range axis(const Body::Bounds &region, float3 center, float3 half, int axis) {
+        float lower = region.lower[axis] - center[axis];
+        float upper = region.upper[axis] - center[axis];
+        Range offset = { .lower = 0.0f, .upper = std::max(-lower, upper) };
+        if (lower > 0.0f) offset = { .lower = lower, .upper = upper };
+        if (upper < 0.0f) offset = { .lower = -upper, .upper = -lower };
+        return { .lower = offset.lower - half[axis], .upper = offset.upper - half[axis] };
+    }
+
+    // Bodies are never below the distance to their bounds, its per-axis part is smallest at the bounds middle
+    static float outside(const Body::Bounds &bounds, const Body::Bounds &region) {
+        float lower = -infinity;
+        for (int idx = 0; idx < 3; idx++) {
+            if (!std::isfinite(bounds.lower[idx]) || !std::isfinite(bounds.upper[idx])) continue;
+            float middle = (bounds.lower[idx] + bounds.upper[idx]) / 2;
+            float closest = std::min(std::max(middle, region.lower[idx]), region.upper[idx]);
+            lower = std::max(lower, std::max(bounds.lower[idx] - closest, closest - bounds.upper[idx]));
+        }
+        return lower;
+    }
+
+    static Range sphere(const Body::Sphere *obj, const Body::Bounds &region) {
+        float3 nearest, farthest;
+        for (int idx = 0; idx < 3; idx++) {
+            Range offset = axis(region, obj->position, float3(0.0f), idx);
+            nearest[idx] = offset.lower;
+            farthest[idx] = offset.upper;
+        }
+        return { .lower = length(nearest) - obj->radius, .upper = length(farthest) - obj->radius };
+    }
+
+    // Box distance is the largest axis distance
+    static Range box(float3 position, float3 half, const Body::Bounds &region) {
+        Range range = { .lower = -infinity, .upper = -infinity };
+        for (int idx = 0; idx < 3; idx++)
+            range = apply(Body::Mode::INTERSECTION, range, axis(region, position, half, idx));
+        return range;
+    }
+
+    // Cross distance is the middle axis distance, the median grows with every argument
+    static Range cross(const Body::Cross *obj, const Body::Bounds &region) {
+        float lowers[3], uppers[3];
+        for (int idx = 0; idx < 3; idx++) {
+            Range range = axis(region, obj->position, obj->size / 2, idx);
+            lowers[idx] = range.lower;
+            uppers[idx] = range.upper;
+        }
+        std::sort(lowers, lowers + 3);
+        std::sort(uppers, uppers + 3);
+        return { .lower = lowers[1], .upper = uppers[1] };
+    }
+
+    // Distance bounds of the body over the region, transformed lists and sponges only know their bounds
+    Range range(Body::Base *body, const Body::Bounds &region) {
+        switch (body->type) {
+            case Body::Type::SPHERE:
+                return sphere(static_cast<Body::Sphere*>(body), region);
+
+            case Body::Type::BOX:
+            {
+                Body::Box *obj = static_cast<Body::Box*>(body);
+                return box(obj->position, obj->size / 2, region);
+            }
+
+            case Body::Type::CROSS:
+                return cross(static_cast<Body::Cross*>(body), region);
+
+            // The sponge is carved out of its box
+            case Body::Type::MENGER:
+            {
+                Body::Menger *obj = static_cast<Body::Menger*>(body);
+                return { .lower = box(obj->position, float3(obj->size / 2), region).lower, .upper = infinity };
+            }
+
+            case Body::Type::LIST:
+            {
+                Body::List *list = static_cast<Body::List*>(body);
+                if (list->bodies.empty()) return { .lower = infinity, .upper = infinity };
+
+                Range surface = range(list->bodies[0], region);
+                if (list->mode == Body::Mode::COMPLEMENT) surface = negate(surface);
+                for (size_t idx = 1; idx < list->bodies.size(); idx++)
+                    surface = apply(list->mode, surface, range(list->bodies[idx], region));
+                surface.lower = std::max(surface.lower, outside(list->bound, region));
+                return surface;
+            }
+
+            default: break;
+        }
+        return { .lower = outside(body->bounds(), region), .upper = infinity };
+    }
+
+    /// Pruning ///
+    // A union child is dropped when it stays past the hit margin or another child is always closer,
+    // nested plain unions are pruned the same way, copies live until the tape is compiled
+    static Body::List *prune(Body::List *list, const Body::Bounds &region, float margin,
+                             std::deque<Body::List> &copies) {
+        size_t count = list->bodies.size();
+        std::vector<Range> ranges(count);
+        for (size_t idx = 0; idx < count; idx++)
+            ranges[idx] = range(list->bodies[idx], region);
+
+        // Closest upper bound over the other children from the two smallest ones
+        size_t best = 0;
+        float first = infinity, second = infinity;
+        for (size_t idx = 0; idx < count; idx++) {
+            if (ranges[idx].upper < first) {
+                second = first;
+                first = ranges[idx].upper;
+                best = idx;
+            }
+            else second = std::min(second, ranges[idx].upper);
+        }
+
+        std::map<Body::Base*, Body::Base*> kept;
+        for (size_t idx = 0; idx < count; idx++) {
+            float others = idx == best ? second : first;
+            if (ranges[idx].lower > margin || ranges[idx].lower > others) continue;
+
+            Body::Base *body = list->bodies[idx];
+            Body::List *child = static_cast<Body::List*>(body);
+            bool nested = body->type == Body::Type::LIST && child->mode == Body::Mode::UNION;
+            kept[body] = nested ? prune(child, region, margin, copies) : body;
+        }
+
+        copies.emplace_back(list->mode);
+        Body::List *copy = &copies.back();
+        copy->bound = list->bound;
+        copy->packed = list->packed;
+        for (Body::Base *body : list->bodies) {
+            if (kept.count(body)) copy->bodies.push_back(kept[body]);
+        }
+        if (!list->packed) return copy;
+
+        // Pooled children are not loose, a pool stays whole while any of its bodies is kept
+        std::map<Body::Type, bool> pooled;
+        for (Body::Base *body : list->bodies) {
+            bool loose = std::find(list->loose.begin(), list->loose.end(), body) != list->loose.end();
+            if (!loose) pooled[body->type] = pooled[body->type] || kept.count(body);
+        }
+        for (Body::Base *body : list->loose) {
+            if (kept.count(body)) copy->loose.push_back(kept[body]);
+        }
+        for (Body::Pool *pool : list->pools) {
+            if (pooled[pool->type]) copy->pools.push_back(pool);
+        }
+
+        // Pools never come first
+        if (copy->loose.empty() && !copy->pools.empty()) copy->loose.push_back(list->loose[0]);
+        return copy;
+    }
+
+    // Tape of the tree pruned to the region, only unions are pruned
+    size_t compile(Body::List *tree, const Body::Bounds &region, float margin, Tape::Program &program) {
+        std::deque<Body::List> copies;
+        Body::List *pruned = tree;
+        if (tree->type == Body::Type::LIST && tree->mode == Body::Mode::UNION)
+            pruned = prune(tree, region, margin, copies);
+
+        // The fallback tree must outlive the copies
+        Tape::compile(pruned, program);
+        if (program.tree && pruned != tree) Tape::compile(tree, program);
+        return cost(program);
+    }
+
+    // Bodies evaluated by the tape, pools count every body
+    size_t cost(const Tape::Program &program) {
+        size_t total = 0;
+        for (const Tape::Instruction &instruction : program.code) {
+            switch (instruction.op) {
+                case Tape::Op::SPHERE:
+                case Tape::Op::BOX:
+                case Tape::Op::CROSS:
+                case Tape::Op::MENGER:
+                    total++;
+                    break;
+
+                case Tape::Op::POOL:
+                    total += instruction.pool->count;
+                    break;
+
+                default: break;
+            }
+        }
+        return total;
+    }
+}
@@ -12,21 +12,59 @@
 // SSBOs
 #include <cstring>
 
+// Sampling
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
 // Parallel processing
 #include <omp.h>
 
 #include "constants.h"
 #include "body.h"
+#include "bvh.h"
+#include "simd.h"
+#include "stats.h"
 #include "scene.h"
+#include "packet.h"
+#include "prune.h"
 #include "render.h"
 
 using namespace LiteMath;
 using namespace LiteImage;
 
 namespace render {
+    int kernel = constants::SSAA::kernel;
+    bool shared = constants::SSAA::shared;
+    Pattern pattern = Pattern::GRID;
+    int count = constants::SSAA::samples;
 
     /// CPU ///
-    static void pixel(Image2D<float4> &image, int2 coord);
+    static void corners(int2 coord, float2 &p1, float2 &p2);
+    static float3 subray(float2 p1, float2 p2, float2 uv);
+    static uint hash(uint value);
+    static int generator(int count);
+    static int samples(void);
+    static float2 grid(int index, int kernel);
+    static float2 offset(int2 coord, int index, int count);
+    static float3 centerray(float2 p1, float2 p2);
+    static float slope(float pixels);
+    static float3 tileray(int2 tile);
+    static void pixel(Image2D<float4> &image, int2 coord, float start = 0.0f, const Tape::Program *tape = nullptr);
+    static void packet(Image2D<float4> &image, int2 coord);
+    static Body::Bounds frustum(int2 corner, int size, float &near, float &far);
+    static void quadtree(Image2D<float4> &image, int2 corner, int size, size_t parent);
+
+    // First pass sample of an adaptive render
+    struct Sample {
+        float3 color;
+        float depth;
+        float3 normal;
+    };
+
+    static float edge(const Sample &sample, const Sample &neighbour);
+    static void refine(Image2D<float4> &image, int2 coord, int kernel, float3 first);
 
     /// GPU ///
     GLFWwindow* window;
@@ -35,6 +73,12 @@ namespace render {
     GLuint bodySSBO;
     GLuint treeSSBO;
     GLuint lightSSBO;
+    GLuint bvhSSBO;
+    GLuint itemSSBO;
+    GLuint counterSSBO;
+    GLuint depthSSBO;
+    GLuint primitiveSSBO;
+    GLuint sampleSSBO;
     static void gentexture(void);
     static uint type(Body::Type type);
     static uint mode(Body::Mode mode);
@@ -52,10 +96,19 @@ namespace render {
             float data[4 * constants::gpu::bodyElements];
         };
 
-        // List Node
+        // List Node, metadata yzw hold list bounds,
+        // list reference yz hold the transform type and ID
         struct Node {
-            uint type[4]; // Mode OR Type
-            uint ID[4];   // Total OR ID
+            uint type[4]; // Mode OR Type, bounds lower corner
+            uint ID[4];   // Total OR ID, bounds upper corner
+        };
+
+        // BVH Node, leaf items are offsets in the top-level list
+        struct BVHNode {
+            float lower[3];
+            uint first;
+            float upper[3];
+            uint count;
         };
 
         // Stack Item
@@ -65,12 +118,18 @@ namespace render {
         };
 
         static void packbody(::Body::Base *in, Body *out);
+        static void packbounds(::Body::Bounds in, Node *out);
         static void packlight(::Object::Light *in, Body *out);
+        static void packprimitive(const Analytic::Primitive &in, Body *out);
         static void packmatrix(float4x4 in, float out[16]);
         static void genscene(
             Body bodies[constants::gpu::bodyTypes * constants::gpu::bodyMax],
             Node tree[constants::gpu::listEntries * constants::gpu::listMax]);
         static void genlights(Body lights[constants::gpu::lights]);
+        static uint genprimitives(Body primitives[constants::gpu::primitivesMax]);
+        static bool genbvh(
+            BVHNode nodes[constants::gpu::bvhMax],
+            uint items[constants::gpu::listMax]);
     };
 }
 
@@ -78,8 +137,8 @@ namespace render {
 ///                 CPU                 ///
 ///////////////////////////////////////////
 
-// Calculate pixel at the given image coord
-void render::pixel(Image2D<float4> &image, int2 coord) {
+// Calculate screen space corners of the pixel at the given image coord
+void render::corners(int2 coord, float2 &p1, float2 &p2) {
     static const float AR = float(constants::width) / constants::height;
 
     float w = scene::camera->focal;
@@ -94,32 +153,228 @@ void render::pixel(Image2D<float4> &image, int2 coord) {
     int2 offset     = int2(1, 1);
     float2 uv2      = float2(coord + offset) * psize;
 
-    float2 p1       = float2( lerp( s1.x, s2.x, uv1.x), lerp( s1.y, s2.y, uv1.y) ); // pixel top left corner
-    float2 p2       = float2( lerp( s1.x, s2.x, uv2.x), lerp( s1.y, s2.y, uv2.y) ); // pixel bottom right corner
+    p1 = float2( lerp( s1.x, s2.x, uv1.x), lerp( s1.y, s2.y, uv1.y) ); // pixel top left corner
+    p2 = float2( lerp( s1.x, s2.x, uv2.x), lerp( s1.y, s2.y, uv2.y) ); // pixel bottom right corner
+}
+
+// Calculate world space direction of the SSAA sub-ray at uv inside the pixel
+float3 render::subray(float2 p1, float2 p2, float2 uv) {
+    float x = lerp( p1.x, p2.x, uv.x);
+    float y = lerp( p1.y, p2.y, uv.y);
+    float z = -1.0f;
+    float3 ray = normalize( float3(x, y, z) );
+    return scene::camera->view(ray, false);
+}
+
+// Integer hash with good avalanche, jitter of the same pixel and seed repeats
+uint render::hash(uint value) {
+    value ^= value >> 16;
+    value *= 0x7FEB352Du;
+    value ^= value >> 15;
+    value *= 0x846CA68Bu;
+    value ^= value >> 16;
+    return value;
+}
+
+// Rank-1 lattice generator of count points with the largest least distance over the wrapped pixel
+int render::generator(int count) {
+    static const std::vector<int> generators = [] {
+        std::vector<int> generators(constants::SSAA::samplesMax + 1, 1);
+        for (int count = 2; count <= constants::SSAA::samplesMax; count++) {
+            float best = 0.0f;
+            for (int candidate = 1; candidate < count; candidate++) {
+                float least = 1.0f;
+                for (int index = 1; index < count; index++) {
+                    float x = float(index) / count;
+                    float y = float(index * candidate % count) / count;
+                    x = std::min(x, 1.0f - x);
+                    y = std::min(y, 1.0f - y);
+                    least = std::min(least, x * x + y * y);
+                }
+                if (least > best) {
+                    best = least;
+                    generators[count] = candidate;
+                }
+            }
+        }
+        return generators;
+    }();
+    return generators[count];
+}
+
+// Rays per pixel of the selected pattern
+// A kernel or ray count past the sub-ray arrays is clamped, every render calls it before its threads read them
+int render::samples() {
+    static const int kernelMax = constants::SSAA::kernelMax;
+    static const int samplesMax = constants::SSAA::samplesMax;
+    if (render::kernel < 1 || render::kernel > kernelMax) {
+        int kernel = std::min(std::max(render::kernel, 1), kernelMax);
+        std::cout << "[Error] SSAA kernel " << render::kernel << " is out of [1, " << kernelMax
+                  << "], taking " << kernel << std::endl;
+        render::kernel = kernel;
+    }
+    if (render::count < 1 || render::count > samplesMax) {
+        int count = std::min(std::max(render::count, 1), samplesMax);
+        std::cout << "[Error] SSAA ray count " << render::count << " is out of [1, " << samplesMax
+                  << "], taking " << count << std::endl;
+        render::count = count;
+    }
+    return render::pattern == Pattern::GRID ? render::kernel * render::kernel : render::count;
+}
+
+// Sub-ray index of the kernel squared grid, the last one is the same for every kernel
+float2 render::grid(int index, int kernel) {
+    return float2( index / kernel + 1, index % kernel + 1 ) / kernel;
+}
+
+// Position inside the pixel of the sub-ray index out of count for the selected pattern
+float2 render::offset(int2 coord, int index, int count) {
+    static const float R2x = 0.7548776662f;     // Inverse plastic number and its square
+    static const float R2y = 0.5698402910f;
+    static const float unit = 1.0f / 4294967296.0f;
+
+    switch (render::pattern) {
+        case Pattern::GRID:
+            return render::grid(index, render::kernel);
+
+        // One sub-ray per column, the rows are sheared by the lattice generator
+        case Pattern::ROTATED:
+            return float2( index + 0.5f, index * render::generator(count) % count + 0.5f ) / count;
+
+        // Rotated grid rows shifted by a random amount per pixel and sub-rays jittered inside their cells,
+        // every sub-ray is uniform over its column so the mean is unbiased
+        case Pattern::JITTER:
+        {
+            uint pixel = render::hash(constants::SSAA::seed ^ render::hash(coord.x ^ render::hash(coord.y)));
+            uint jitter = render::hash(pixel + index);
+            int row = (index * render::generator(count) + pixel % count) % count;
+            float x = (jitter & 0xFFFF) / 65536.0f;
+            float y = (jitter >> 16) / 65536.0f;
+            return float2( index + x, row + y ) / count;
+        }
+
+        // Bit reversed index and the second Sobol dimension, centered on their count strata
+        case Pattern::SOBOL:
+        {
+            uint x = 0, y = 0;
+            for (uint bits = index, v = 1u << 31, bit = 1u << 31; bits; bits >>= 1, v ^= v >> 1, bit >>= 1) {
+                if (bits & 1) {
+                    x |= bit;
+                    y ^= v;
+                }
+            }
+            float u = x * unit + 0.5f / count;
+            float v = y * unit + 0.5f / count;
+            return float2( u - std::floor(u), v - std::floor(v) );
+        }
+
+        case Pattern::R2:
+        {
+            float u = 0.5f + index * R2x;
+            float v = 0.5f + index * R2y;
+            return float2( u - std::floor(u), v - std::floor(v) );
+        }
+
+        default: break;
+    }
+    return float2(1.0f);
+}
+
+// Calculate world space direction through the center of the screen rectangle
+float3 render::centerray(float2 p1, float2 p2) {
+    float2 center = (p1 + p2) / 2.0f;
+    float3 ray = normalize( float3(center.x, center.y, -1.0f) );
+    return scene::camera->view(ray, false);
+}
+
+// Cone radius per unit of distance covering every ray of a square of pixels
+float render::slope(float pixels) {
+    float pixel = scene::camera->focal / constants::width;
+    return pixels * pixel * std::sqrt(0.5f);
+}
+
+// Calculate world space direction through the center of the prepass tile
+float3 render::tileray(int2 tile) {
+    static const int size = constants::cone::tile;
+    float2 p1, p2, q1, q2;
+    render::corners(int2(tile.x * size, tile.y * size), p1, p2);
+    render::corners(int2(tile.x * size + size - 1, tile.y * size + size - 1), q1, q2);
+    return render::centerray(p1, q2);
+}
+
+// Calculate pixel at the given image coord, its rays are empty up to start
+void render::pixel(Image2D<float4> &image, int2 coord, float start, const Tape::Program *tape) {
+    float2 p1, p2;
+    render::corners(coord, p1, p2);
 
     float3 position = float3(0.0f);
     position = scene::camera->view(position);
 
+    // Sub-rays share one cone march through the pixel center until the cone touches the surface
+    stats::add(stats::PIXELS);
+    if (render::shared) start = scene::cone(position, render::centerray(p1, p2), render::slope(1.0f), start);
+
     float3 total = float3(0.0f);
-    for (int i = 0; i < constants::SSAA::kernel; i++) {
-        for (int j = 0; j < constants::SSAA::kernel; j++) {
-            float2 uv = float2( i + 1, j + 1 ) / constants::SSAA::kernel;
-            float x = lerp( p1.x, p2.x, uv.x);
-            float y = lerp( p1.y, p2.y, uv.y);
-            float z = -1.0f;
-            float3 ray = normalize( float3(x, y, z) );
-            ray = scene::camera->view(ray, false);
-
-            float3 color = scene::raymarch(position, ray);
-            total += color;
-        }
+    const int samples = render::samples();
+    for (int idx = 0; idx < samples; idx++) {
+        float depth;
+        float3 ray = render::subray(p1, p2, render::offset(coord, idx, samples));
+        float3 color = scene::raymarch(position, ray, start, depth, tape);
+        total += color;
+    }
+
+    float3 color = total / samples;
+    image[coord] = float4(color.x, color.y, color.z, 1.0f);
+}
+
+// Calculate pixel at the given image coord marching sub-rays in packets
+void render::packet(Image2D<float4> &image, int2 coord) {
+    static const int samplesMax = constants::SSAA::samplesMax;
+    const int samples = render::samples();
+
+    float2 p1, p2;
+    render::corners(coord, p1, p2);
+
+    float3 position = float3(0.0f);
+    position = scene::camera->view(position);
+
+    stats::add(stats::PIXELS);
+    float start = render::shared ? scene::cone(position, render::centerray(p1, p2), render::slope(1.0f)) : 0.0f;
+
+    // Unused lanes of the last packet repeat the first sub-ray
+    float x[samplesMax + simd::lanes], y[samplesMax + simd::lanes], z[samplesMax + simd::lanes];
+    for (int idx = 0; idx < samples + simd::lanes; idx++) {
+        int sample = idx < samples ? idx : 0;
+        float3 ray = render::subray(p1, p2, render::offset(coord, sample, samples));
+        x[idx] = ray.x;
+        y[idx] = ray.y;
+        z[idx] = ray.z;
+    }
+
+    float lane[simd::lanes];
+    for (int idx = 0; idx < simd::lanes; idx++) lane[idx] = idx;
+    simd::vfloat lanes = simd::load(lane);
+
+    float3 total = float3(0.0f);
+    for (int first = 0; first < samples; first += simd::lanes) {
+        simd::vfloat3 ray = { simd::load(x + first), simd::load(y + first), simd::load(z + first) };
+        simd::vmask active = simd::lt(lanes, simd::set(samples - first));
+        simd::vfloat3 color = ::packet::raymarch(position, ray, active, start);
+
+        float r[simd::lanes], g[simd::lanes], b[simd::lanes];
+        simd::store(r, color.x);
+        simd::store(g, color.y);
+        simd::store(b, color.z);
+        for (int idx = 0; idx < simd::lanes && first + idx < samples; idx++)
+            total += float3(r[idx], g[idx], b[idx]);
     }
 
-    float3 color = total / (constants::SSAA::kernel * constants::SSAA::kernel);
+    float3 color = total / samples;
     image[coord] = float4(color.x, color.y, color.z, 1.0f);
 }
 
 void render::CPU(Image2D<float4> &image) {
+    render::samples();
     for (int pi = 0; pi < constants::height; pi++) {
         for (int pj = 0; pj < constants::width; pj++) {
             int2 coord(pj, pi);
@@ -128,12 +383,240 @@ void render::CPU(Image2D<float4> &image) {
     }
 }
 
-void render::OMP(Image2D<float4> &image) {
+// Pixels start at the depth of their tile when the prepass depths are given
+void render::OMP(Image2D<float4> &image, const std::vector<float> &depths) {
+    static const uint tiles = (constants::width + constants::cone::tile - 1) / constants::cone::tile;
+    render::samples();
     #pragma omp parallel for
     for (int pi = 0; pi < constants::height; pi++) {
         for (int pj = 0; pj < constants::width; pj++) {
             int2 coord(pj, pi);
-            pixel(image, coord);
+            float start = depths.empty() ? 0.0f : depths[pi / constants::cone::tile * tiles + pj / constants::cone::tile];
+            pixel(image, coord, start);
+        }
+    }
+}
+
+// Box around the tile rays inside the scene bounds past the depth where the tile cone touches the surface
+// Rays through the tile corners span a pyramid, it is cut by planes across the center ray
+Body::Bounds render::frustum(int2 corner, int size, float &near, float &far) {
+    int2 last = int2(std::min(corner.x + size, int(constants::width)) - 1,
+                     std::min(corner.y + size, int(constants::height)) - 1);
+    float2 p1, p2, q1, q2;
+    render::corners(corner, p1, p2);
+    render::corners(last, q1, q2);
+
+    float3 position = scene::camera->view(float3(0.0f));
+    float3 center = render::centerray(p1, q2);
+    float2 screen[4] = { p1, float2(q2.x, p1.y), float2(p1.x, q2.y), q2 };
+    float3 rays[4];
+    float cosine = 1.0f;
+    for (int idx = 0; idx < 4; idx++) {
+        rays[idx] = scene::camera->view(normalize(float3(screen[idx].x, screen[idx].y, -1.0f)), false);
+        cosine = std::min(cosine, dot(rays[idx], center));
+    }
+
+    near = scene::cone(position, center, render::slope(float(size)));
+    far = 0.0f;
+    for (int idx = 0; idx < 8; idx++) {
+        float3 point = float3(idx & 1 ? scene::bounds.upper.x : scene::bounds.lower.x,
+                              idx & 2 ? scene::bounds.upper.y : scene::bounds.lower.y,
+                              idx & 4 ? scene::bounds.upper.z : scene::bounds.lower.z);
+        far = std::max(far, length(point - position));
+    }
+    far = std::min(far, constants::march::distance);
+
+    Body::Bounds region = Body::Bounds::empty();
+    for (int idx = 0; idx < 4; idx++) {
+        float3 front = position + rays[idx] * (near * cosine / dot(rays[idx], center));
+        float3 back = position + rays[idx] * (far / dot(rays[idx], center));
+        region = Body::Bounds::merge(region, { .lower = min(front, back), .upper = max(front, back) });
+    }
+    return Body::Bounds::intersect(region, scene::bounds);
+}
+
+// Tiles are split while their children drop more bodies, leaves march their pixels against their own tape
+void render::quadtree(Image2D<float4> &image, int2 corner, int size, size_t parent) {
+    if (corner.x >= int(constants::width) || corner.y >= int(constants::height)) return;
+
+    float near, far;
+    Body::Bounds region = render::frustum(corner, size, near, far);
+    float margin = std::max(constants::precision::surface, scene::footprint * far);
+    Tape::Program tape;
+    size_t cost = Prune::compile(scene::tree, region, margin, tape);
+
+    if (size > constants::prune::leaf && cost > 0 && cost < parent) {
+        int half = size / 2;
+        for (int idx = 0; idx < 4; idx++)
+            render::quadtree(image, int2(corner.x + idx % 2 * half, corner.y + idx / 2 * half), half, cost);
+        return;
+    }
+
+    int2 last = int2(std::min(corner.x + size, int(constants::width)), std::min(corner.y + size, int(constants::height)));
+    for (int pi = corner.y; pi < last.y; pi++) {
+        for (int pj = corner.x; pj < last.x; pj++)
+            render::pixel(image, int2(pj, pi), near, &tape);
+    }
+}
+
+// Root tiles are rendered in parallel and always split once
+void render::Pruned(Image2D<float4> &image) {
+    static const int tile = constants::prune::tile;
+    static const int tilesX = (constants::width + tile - 1) / tile;
+    static const int tilesY = (constants::height + tile - 1) / tile;
+    render::samples();
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int index = 0; index < tilesX * tilesY; index++) {
+        int2 corner = int2(index % tilesX * tile, index / tilesX * tile);
+        render::quadtree(image, corner, tile, std::numeric_limits<size_t>::max());
+    }
+}
+
+void render::Prepass(std::vector<float> &depths) {
+    static const uint tile = constants::cone::tile;
+    static const int tilesX = (constants::width + tile - 1) / tile;
+    static const int tilesY = (constants::height + tile - 1) / tile;
+    depths.resize(tilesX * tilesY);
+
+    float3 position = scene::camera->view(float3(0.0f));
+    float slope = render::slope(constants::cone::tile);
+    #pragma omp parallel for
+    for (int ti = 0; ti < tilesY; ti++) {
+        for (int tj = 0; tj < tilesX; tj++)
+            depths[ti * tilesX + tj] = scene::cone(position, render::tileray(int2(tj, ti)), slope);
+    }
+}
+
+// Edge strength between the samples of neighbour pixels, above 1 once a threshold is crossed
+float render::edge(const Sample &sample, const Sample &neighbour) {
+    bool hit = !std::isinf(sample.depth);
+    if (hit != !std::isinf(neighbour.depth)) return std::numeric_limits<float>::infinity();
+
+    float3 difference = abs(sample.color - neighbour.color);
+    float strength = std::max(difference.x, std::max(difference.y, difference.z)) / constants::adaptive::color;
+    if (!hit) return strength;
+
+    float depth = std::abs(sample.depth - neighbour.depth) / std::min(sample.depth, neighbour.depth);
+    float normal = (1.0f - dot(sample.normal, neighbour.normal)) / (1.0f - constants::adaptive::normal);
+    return std::max(strength, std::max(depth / constants::adaptive::depth, normal));
+}
+
+// Supersample the pixel at the given image coord, first is the color of its last sub-ray
+void render::refine(Image2D<float4> &image, int2 coord, int kernel, float3 first) {
+    float2 p1, p2;
+    render::corners(coord, p1, p2);
+
+    float3 position = float3(0.0f);
+    position = scene::camera->view(position);
+
+    float start = render::shared ? scene::cone(position, render::centerray(p1, p2), render::slope(1.0f)) : 0.0f;
+
+    float3 total = first;
+    for (int idx = 0; idx < kernel * kernel - 1; idx++) {
+        float3 ray = render::subray(p1, p2, render::grid(idx, kernel));
+        total += scene::raymarch(position, ray, start);
+    }
+
+    float3 color = total / (kernel * kernel);
+    image[coord] = float4(color.x, color.y, color.z, 1.0f);
+}
+
+// One sample per pixel first, pixels across an edge with one of their 8 neighbours are supersampled after,
+// the kernel grows with the edge strength up to render::kernel, samples holds the rays of every pixel
+// Sub-rays stay on the grid whatever the pattern, its last one is the first sample of every kernel
+void render::Adaptive(Image2D<float4> &image, std::vector<int> &samples) {
+    static const int width = constants::width;
+    static const int height = constants::height;
+    std::vector<Sample> first(width * height);
+    samples.assign(width * height, 1);
+    render::samples();
+
+    #pragma omp parallel for
+    for (int pi = 0; pi < height; pi++) {
+        for (int pj = 0; pj < width; pj++) {
+            int2 coord(pj, pi);
+            float2 p1, p2;
+            render::corners(coord, p1, p2);
+            float3 position = scene::camera->view(float3(0.0f));
+
+            stats::add(stats::PIXELS);
+            Sample &sample = first[pi * width + pj];
+            float3 ray = render::subray(p1, p2, render::grid(0, 1));
+            sample.color = scene::raymarch(position, ray, 0.0f, sample.depth, sample.normal);
+            image[coord] = float4(sample.color.x, sample.color.y, sample.color.z, 1.0f);
+        }
+    }
+    if (render::kernel < 2) return;
+
+    #pragma omp parallel for
+    for (int pi = 0; pi < height; pi++) {
+        for (int pj = 0; pj < width; pj++) {
+            float strength = 0.0f;
+            for (int y = std::max(pi - 1, 0); y <= std::min(pi + 1, height - 1); y++) {
+                for (int x = std::max(pj - 1, 0); x <= std::min(pj + 1, width - 1); x++)
+                    strength = std::max(strength, render::edge(first[pi * width + pj], first[y * width + x]));
+            }
+            if (strength <= 1.0f) continue;
+
+            int kernel = std::max(2, int(std::ceil(std::min(strength, float(render::kernel)))));
+            samples[pi * width + pj] = kernel * kernel;
+            render::refine(image, int2(pj, pi), kernel, first[pi * width + pj].color);
+        }
+    }
+}
+
+// Sample counts as gray levels, white at constants::SSAA::kernelMax squared
+void render::Samples(const std::vector<int> &samples, Image2D<float4> &image) {
+    static const float most = constants::SSAA::kernelMax * constants::SSAA::kernelMax;
+    for (int pi = 0; pi < constants::height; pi++) {
+        for (int pj = 0; pj < constants::width; pj++) {
+            float level = samples[pi * constants::width + pj] / most;
+            image[int2(pj, pi)] = float4(level, level, level, 1.0f);
+        }
+    }
+}
+
+// Rays sit at the centers of the lattice cells, so the reference is not shifted against the patterns it rates
+void render::Reference(Image2D<float4> &image) {
+    static const int kernel = constants::SSAA::reference;
+    float3 position = scene::camera->view(float3(0.0f));
+    #pragma omp parallel for
+    for (int pi = 0; pi < constants::height; pi++) {
+        for (int pj = 0; pj < constants::width; pj++) {
+            int2 coord(pj, pi);
+            float2 p1, p2;
+            render::corners(coord, p1, p2);
+            float3 total = float3(0.0f);
+            for (int idx = 0; idx < kernel * kernel; idx++) {
+                float depth;
+                float2 uv = float2( idx / kernel + 0.5f, idx % kernel + 0.5f ) / kernel;
+                total += scene::raymarch(position, render::subray(p1, p2, uv), 0.0f, depth);
+            }
+            float3 color = total / (kernel * kernel);
+            image[coord] = float4(color.x, color.y, color.z, 1.0f);
+        }
+    }
+}
+
+float render::RMSE(const Image2D<float4> &image, const Image2D<float4> &reference) {
+    double total = 0.0;
+    for (int pi = 0; pi < constants::height; pi++) {
+        for (int pj = 0; pj < constants::width; pj++) {
+            float4 difference = clamp(image[int2(pj, pi)], 0.0f, 1.0f) - clamp(reference[int2(pj, pi)], 0.0f, 1.0f);
+            total += difference.x * difference.x + difference.y * difference.y + difference.z * difference.z;
+        }
+    }
+    return std::sqrt(total / (3.0 * constants::width * constants::height));
+}
+
+void render::Packet(Image2D<float4> &image) {
+    render::samples();
+    #pragma omp parallel for
+    for (int pi = 0; pi < constants::height; pi++) {
+        for (int pj = 0; pj < constants::width; pj++) {
+            int2 coord(pj, pi);
+            packet(image, coord);
         }
     }
 }
@@ -269,15 +752,55 @@ void render::shader::packbody(::Body::Base *in, render::shader::Body *out) {
             std::memcpy(out->data + 8, obj->color.M, sizeof(obj->color.M));
             break;
         }
+        case ::Body::Type::MENGER:
+        {
+            ::Body::Menger *obj = static_cast<::Body::Menger*>(in);
+            float iterations = obj->iterations;
+            std::memcpy(out->data, obj->position.M, sizeof(obj->position.M));
+            std::memcpy(out->data + 4, &obj->size, sizeof(obj->size));
+            std::memcpy(out->data + 5, &iterations, sizeof(iterations));
+            std::memcpy(out->data + 8, obj->color.M, sizeof(obj->color.M));
+            break;
+        }
+        case ::Body::Type::REPEAT:
+        {
+            ::Body::Repeat *obj = static_cast<::Body::Repeat*>(in);
+            float3 count = float3(obj->count.x, obj->count.y, obj->count.z);
+            std::memcpy(out->data, obj->position.M, sizeof(obj->position.M));
+            std::memcpy(out->data + 4, obj->period.M, sizeof(obj->period.M));
+            std::memcpy(out->data + 8, count.M, sizeof(count.M));
+            break;
+        }
+        case ::Body::Type::MIRROR:
+        {
+            ::Body::Mirror *obj = static_cast<::Body::Mirror*>(in);
+            std::memcpy(out->data, obj->position.M, sizeof(obj->position.M));
+            std::memcpy(out->data + 4, obj->normal.M, sizeof(obj->normal.M));
+            break;
+        }
         default: break;
     }
 }
 
+void render::shader::packbounds(::Body::Bounds in, render::shader::Node *out) {
+    std::memcpy(out->type + 1, in.lower.M, sizeof(in.lower.M));
+    std::memcpy(out->ID + 1, in.upper.M, sizeof(in.upper.M));
+}
+
 void render::shader::packlight(::Object::Light *in, render::shader::Body *out) {
     std::memcpy(out->data, in->position.M, sizeof(in->position.M));
     std::memcpy(out->data + 4, in->color.M, sizeof(in->color.M));
 }
 
+// Type goes to the position w, sphere radius or box half extents to size
+void render::shader::packprimitive(const Analytic::Primitive &in, render::shader::Body *out) {
+    float type = render::type(in.type);
+    std::memcpy(out->data, in.position.M, sizeof(in.position.M));
+    std::memcpy(out->data + 3, &type, sizeof(type));
+    std::memcpy(out->data + 4, in.size.M, sizeof(in.size.M));
+    std::memcpy(out->data + 8, in.color.M, sizeof(in.color.M));
+}
+
 void render::shader::packmatrix(float4x4 in, float out[16]) {
     std::memcpy(out, in.m_col[0].M, sizeof(in.m_col[0].M));
     std::memcpy(out + 4, in.m_col[1].M, sizeof(in.m_col[1].M));
@@ -291,6 +814,47 @@ void render::shader::genlights(render::shader::Body lights[constants::gpu::light
     }
 }
 
+uint render::shader::genprimitives(render::shader::Body primitives[constants::gpu::primitivesMax]) {
+    const std::vector<Analytic::Primitive> &set = scene::analytic.primitives;
+    if (set.size() > constants::gpu::primitivesMax) {
+        std::cout << "[Error] Analytic primitives exceed GPU buffers" << std::endl;
+        return 0;
+    }
+
+    for (uint ID = 0; ID < set.size(); ID++) {
+        render::shader::packprimitive(set[ID], primitives + ID);
+    }
+    return set.size();
+}
+
+// Flatten the scene BVH, unbounded items go first
+bool render::shader::genbvh(
+    render::shader::BVHNode nodes[constants::gpu::bvhMax],
+    uint items[constants::gpu::listMax]) {
+
+    const BVH::Tree &bvh = scene::bvh;
+    if (!bvh.active) return false;
+    if (bvh.nodes.size() > constants::gpu::bvhMax || bvh.programs.size() > constants::gpu::listMax - 1) {
+        std::cout << "[Error] Scene BVH exceeds GPU buffers" << std::endl;
+        return false;
+    }
+
+    size_t unbounded = bvh.unbounded.size();
+    for (size_t idx = 0; idx < unbounded; idx++)
+        items[idx] = bvh.unbounded[idx] + 1;
+    for (size_t idx = 0; idx < bvh.items.size(); idx++)
+        items[unbounded + idx] = bvh.items[idx] + 1;
+
+    for (size_t idx = 0; idx < bvh.nodes.size(); idx++) {
+        const BVH::Node &node = bvh.nodes[idx];
+        std::memcpy(nodes[idx].lower, node.bounds.lower.M, sizeof(nodes[idx].lower));
+        std::memcpy(nodes[idx].upper, node.bounds.upper.M, sizeof(nodes[idx].upper));
+        nodes[idx].first = node.count > 0 ? node.first + unbounded : node.first;
+        nodes[idx].count = node.count;
+    }
+    return true;
+}
+
 void render::shader::genscene(
     render::shader::Body bodies[constants::gpu::bodyTypes * constants::gpu::bodyMax],
     render::shader::Node tree[constants::gpu::listEntries * constants::gpu::listMax]) {
@@ -305,6 +869,7 @@ void render::shader::genscene(
 
     render::shader::Node node { .type = { render::mode(scene::tree->mode) }, .ID = { 0U } }; // Metadata: Mode, Size
     tree[0] = node;
+    render::shader::packbounds(scene::tree->bound, tree);
     render::shader::Node *entry = tree;
 
     render::shader::Item item { .ID = { 0U }, .offset = { 0U } };
@@ -330,17 +895,24 @@ void render::shader::genscene(
         body = list->bodies[listOffset - 1];
         uint type = render::type(body->type);
         entry[0].ID[0] = listOffset;
-        if (body->type == ::Body::Type::LIST) {
+        if (::Body::composite(body->type)) {
             // Update the stacks
             liststack[stackSize] = static_cast<::Body::List*>(body);
             item.ID[0] = treeSize;
             item.offset[0] = 0U;
             stack[stackSize] = item;
 
-            // Push body node to the list
-            node.type[0] = type;
+            // Push body node to the list, transformed lists reference their parameters
+            node.type[0] = render::type(::Body::Type::LIST);
             node.ID[0] = treeSize;
+            if (body->type != ::Body::Type::LIST) {
+                render::shader::packbody(body, &gpuBody);
+                bodies[type * constants::gpu::bodyMax + bodySize[type]] = gpuBody;
+                node.type[1] = type;
+                node.type[2] = bodySize[type]++;
+            }
             entry[listOffset] = node;
+            node.type[1] = node.type[2] = 0U;
 
             // Update new list metadata
             list = liststack[stackSize];
@@ -350,6 +922,7 @@ void render::shader::genscene(
             node.type[0] = mode;
             node.ID[0] = 0U;
             entry[0] = node;
+            render::shader::packbounds(list->bound, entry);
 
             stackSize++; treeSize++;
         } else {
@@ -384,11 +957,39 @@ void render::pushuniforms(void) {
     uniform = glGetUniformLocation(render::shader::program, "surfacePrecision");
     glUniform1f(uniform, constants::precision::surface);
 
+    uniform = glGetUniformLocation(render::shader::program, "footprint");
+    glUniform1f(uniform, scene::footprint);
+
+    uniform = glGetUniformLocation(render::shader::program, "maxDistance");
+    glUniform1f(uniform, constants::march::distance);
+
+    float3 background = constants::march::background;
+    uniform = glGetUniformLocation(render::shader::program, "background");
+    glUniform3f(uniform, background.x, background.y, background.z);
+
+    uniform = glGetUniformLocation(render::shader::program, "boundsLower");
+    glUniform3f(uniform, scene::bounds.lower.x, scene::bounds.lower.y, scene::bounds.lower.z);
+
+    uniform = glGetUniformLocation(render::shader::program, "boundsUpper");
+    glUniform3f(uniform, scene::bounds.upper.x, scene::bounds.upper.y, scene::bounds.upper.z);
+
     uniform = glGetUniformLocation(render::shader::program, "offsetPrecision");
     glUniform1f(uniform, constants::precision::offset);
 
-    uniform = glGetUniformLocation(render::shader::program, "kernelSize");
-    glUniform1i(uniform, constants::SSAA::kernel);
+    uniform = glGetUniformLocation(render::shader::program, "tileSize");
+    glUniform1ui(uniform, constants::cone::tile);
+
+    uniform = glGetUniformLocation(render::shader::program, "shortcut");
+    glUniform1i(uniform, constants::shortcut::enabled);
+
+    uniform = glGetUniformLocation(render::shader::program, "penumbra");
+    glUniform1f(uniform, constants::shadow::penumbra);
+
+    uniform = glGetUniformLocation(render::shader::program, "segmentGrowth");
+    glUniform1f(uniform, constants::segment::growth);
+
+    uniform = glGetUniformLocation(render::shader::program, "sampleSeed");
+    glUniform1ui(uniform, constants::SSAA::seed);
 
     // Light
     uniform = glGetUniformLocation(render::shader::program, "totalLights");
@@ -442,6 +1043,12 @@ void render::setup::buffers() {
     render::genssbo("Bodies", render::bodySSBO, 0);
     render::genssbo("Tree", render::treeSSBO, 1);
     render::genssbo("Lights", render::lightSSBO, 2);
+    render::genssbo("Hierarchy", render::bvhSSBO, 3);
+    render::genssbo("Items", render::itemSSBO, 4);
+    render::genssbo("Counters", render::counterSSBO, 5);
+    render::genssbo("Depths", render::depthSSBO, 6);
+    render::genssbo("Primitives", render::primitiveSSBO, 7);
+    render::genssbo("Samples", render::sampleSSBO, 8);
 }
 
 void render::push(void) {
@@ -452,26 +1059,131 @@ void render::push(void) {
     auto bodies = new render::shader::Body[constants::gpu::bodyTypes * constants::gpu::bodyMax];
     auto tree = new render::shader::Node[constants::gpu::listEntries * constants::gpu::listMax];
     auto lights = new render::shader::Body[constants::gpu::lights];
+    auto nodes = new render::shader::BVHNode[constants::gpu::bvhMax];
+    auto items = new uint[constants::gpu::listMax];
+    auto primitives = new render::shader::Body[constants::gpu::primitivesMax];
 
     render::shader::genscene(bodies, tree);
     render::shader::genlights(lights);
 
+    GLuint uniform;
+    bool bvh = render::shader::genbvh(nodes, items);
+    uniform = glGetUniformLocation(render::shader::program, "bvhNodes");
+    glUniform1ui(uniform, bvh ? scene::bvh.nodes.size() : 0);
+    uniform = glGetUniformLocation(render::shader::program, "bvhUnbounded");
+    glUniform1ui(uniform, bvh ? scene::bvh.unbounded.size() : 0);
+    uniform = glGetUniformLocation(render::shader::program, "totalPrimitives");
+    glUniform1ui(uniform, render::shader::genprimitives(primitives));
+
     render::pushssbo(render::bodySSBO, bodies, constants::gpu::bodyTypes * constants::gpu::bodyMax * sizeof(*bodies));
     render::pushssbo(render::treeSSBO, tree, constants::gpu::listEntries * constants::gpu::listMax * sizeof(*tree));
     render::pushssbo(render::lightSSBO, lights, constants::gpu::lights * sizeof(*lights));
+    render::pushssbo(render::bvhSSBO, nodes, constants::gpu::bvhMax * sizeof(*nodes));
+    render::pushssbo(render::itemSSBO, items, constants::gpu::listMax * sizeof(*items));
+    render::pushssbo(render::primitiveSSBO, primitives, constants::gpu::primitivesMax * sizeof(*primitives));
 
     delete[] bodies;
     delete[] tree;
     delete[] lights;
+    delete[] nodes;
+    delete[] items;
+    delete[] primitives;
 }
 
-void render::GPU(unsigned char *image) {
+// Pixels start at the depth of their tile when seeded by GPUPrepass
+void render::GPU(unsigned char *image, bool seeded) {
+    render::samples();
+    uint counters[2 * stats::COUNTERS] = {};
+    render::pushssbo(render::counterSSBO, counters, sizeof(counters));
+
+    // Marching options are chosen per render
     glUseProgram(render::shader::program);
+    glUniform1f(glGetUniformLocation(render::shader::program, "relaxation"), scene::relaxation);
+    glUniform1i(glGetUniformLocation(render::shader::program, "segmentTracing"), scene::tracing == scene::Tracing::SEGMENT);
+    glUniform1i(glGetUniformLocation(render::shader::program, "seeded"), seeded);
+    glUniform1i(glGetUniformLocation(render::shader::program, "prepass"), false);
+    glUniform1i(glGetUniformLocation(render::shader::program, "adaptivePass"), 0);
+    glUniform1i(glGetUniformLocation(render::shader::program, "kernelSize"), render::kernel);
+    glUniform1i(glGetUniformLocation(render::shader::program, "sharedCone"), render::shared);
+    glUniform1i(glGetUniformLocation(render::shader::program, "samplePattern"), static_cast<int>(render::pattern));
+    glUniform1i(glGetUniformLocation(render::shader::program, "sampleCount"), render::count);
+    glUniform1i(glGetUniformLocation(render::shader::program, "latticeGenerator"), render::generator(render::count));
     glDispatchCompute(
         constants::width / constants::gpu::groupUnits,
         constants::height / constants::gpu::groupUnits, 1);
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
     glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+
+    // Gather the evaluation counters of every invocation
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, render::counterSSBO);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counters), counters);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    for (size_t counter = 0; counter < stats::COUNTERS; counter++) {
+        size_t value = counters[counter] + (size_t(counters[stats::COUNTERS + counter]) << 32);
+        stats::add(static_cast<stats::Counter>(counter), value);
+    }
+}
+
+// Two dispatches, the second one reads the first pass samples of the neighbours
+void render::GPUAdaptive(unsigned char *image, std::vector<int> &samples) {
+    static const size_t pixels = constants::width * constants::height;
+    static const size_t sampleSize = 8 * sizeof(float);     // Sample struct, see compute shader
+    uint counters[2 * stats::COUNTERS] = {};
+    render::pushssbo(render::counterSSBO, counters, sizeof(counters));
+    render::pushssbo(render::sampleSSBO, NULL, pixels * sampleSize);
+    render::samples();
+
+    glUseProgram(render::shader::program);
+    glUniform1f(glGetUniformLocation(render::shader::program, "relaxation"), scene::relaxation);
+    glUniform1i(glGetUniformLocation(render::shader::program, "segmentTracing"), scene::tracing == scene::Tracing::SEGMENT);
+    glUniform1i(glGetUniformLocation(render::shader::program, "seeded"), false);
+    glUniform1i(glGetUniformLocation(render::shader::program, "prepass"), false);
+    glUniform1i(glGetUniformLocation(render::shader::program, "kernelSize"), render::kernel);
+    glUniform1i(glGetUniformLocation(render::shader::program, "sharedCone"), render::shared);
+    glUniform1f(glGetUniformLocation(render::shader::program, "edgeColor"), constants::adaptive::color);
+    glUniform1f(glGetUniformLocation(render::shader::program, "edgeDepth"), constants::adaptive::depth);
+    glUniform1f(glGetUniformLocation(render::shader::program, "edgeNormal"), constants::adaptive::normal);
+    for (int pass = 1; pass <= 2; pass++) {
+        glUniform1i(glGetUniformLocation(render::shader::program, "adaptivePass"), pass);
+        glDispatchCompute(
+            constants::width / constants::gpu::groupUnits,
+            constants::height / constants::gpu::groupUnits, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+    glUniform1i(glGetUniformLocation(render::shader::program, "adaptivePass"), 0);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+
+    // Ray count is the last word of every sample
+    std::vector<uint> buffer(pixels * sampleSize / sizeof(uint));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, render::sampleSSBO);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, pixels * sampleSize, buffer.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, render::counterSSBO);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counters), counters);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    samples.resize(pixels);
+    for (size_t idx = 0; idx < pixels; idx++)
+        samples[idx] = buffer[idx * sampleSize / sizeof(uint) + sampleSize / sizeof(uint) - 1];
+    for (size_t counter = 0; counter < stats::COUNTERS; counter++) {
+        size_t value = counters[counter] + (size_t(counters[stats::COUNTERS + counter]) << 32);
+        stats::add(static_cast<stats::Counter>(counter), value);
+    }
+}
+
+// Separate dispatch with one invocation per tile filling the depth buffer
+void render::GPUPrepass() {
+    static const uint tile = constants::cone::tile;
+    static const uint tilesX = (constants::width + tile - 1) / tile;
+    static const uint tilesY = (constants::height + tile - 1) / tile;
+    static const uint units = constants::gpu::groupUnits;
+    render::pushssbo(render::depthSSBO, NULL, tilesX * tilesY * sizeof(float));
+
+    glUseProgram(render::shader::program);
+    glUniform1i(glGetUniformLocation(render::shader::program, "prepass"), true);
+    glDispatchCompute((tilesX + units - 1) / units, (tilesY + units - 1) / units, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glFinish();
 }
 
 void render::destroy() {
@@ -1,5 +1,6 @@
 #include <LiteMath.h>
 
+#include <cmath>
 #include <limits>
 #include <vector>
 
@@ -7,46 +8,247 @@
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <iostream>
+
+// scene::bake
+#include <cstdint>
+#include <cstdio>
 
 #include "constants.h"
 #include "object.h"
 #include "body.h"
+#include "csg.h"
+#include "tape.h"
+#include "bvh.h"
+#include "cull.h"
+#include "stats.h"
 #include "scene.h"
 
 using namespace LiteMath;
 
 // TODO: free objects when process finished
 namespace scene {
+    Tracing tracing = Tracing::SPHERE;
+    float relaxation = 1.0f;
+    float footprint = 0.0f;     // Primary ray hit threshold per unit of distance, 0 for a fixed threshold
     Body::List *tree;
+    Tape::Program program;
+    BVH::Tree bvh;
+    Cull::Set cull;
+    Analytic::Set analytic;
+    Brick::Map bricks;
+    Body::Bounds bounds = Body::Bounds::infinite();
     std::vector<Object::Light*> lights;
     Object::Camera *camera;
 }
 
-// Calculate the color produced by ray
-float3 scene::raymarch(float3 position, float3 ray) {
-    Body::Surface surface = scene::surface(position, ray);
-    float3 normal = normalize(scene::grad(position));
+namespace scene {
+    // Marched part of the scene, analytic primitives are intersected instead
+    static Body::Surface geometrySDF(float3 position) {
+        if (bvh.active) return bvh.SDF(position);
+        return program.SDF(position);
+    }
+
+    static float geometryDistance(float3 position) {
+        if (bvh.active) return bvh.distance(position);
+        return program.distance(position);
+    }
+}
+
+// Calculate the color produced by ray, the ray is known to be empty up to start
+float3 scene::raymarch(float3 position, float3 ray, float start) {
+    float depth;
+    return scene::raymarch(position, ray, start, depth);
+}
+
+// Depth is the distance to the hit along the ray, infinite on a miss
+float3 scene::raymarch(float3 position, float3 ray, float start, float &depth, const Tape::Program *tape) {
+    float3 normal;
+    return scene::raymarch(position, ray, start, depth, normal, tape);
+}
+
+// Normal of the hit surface, zero on a miss
+float3 scene::raymarch(float3 position, float3 ray, float start, float &depth, float3 &normal, const Tape::Program *tape) {
+    float3 origin = position;
+    Body::Surface surface = scene::surface(position, ray, start, tape);
+    depth = std::numeric_limits<float>::infinity();
+    normal = float3(0.0f);
+    if (std::isinf(surface.SD)) return constants::march::background;
+    depth = dot(position - origin, ray);
+    normal = normalize(scene::grad(position));
     float light = scene::lighting(position, normal);
     float3 color = light * surface.color;
     return color;
 }
 
-Body::Surface scene::surface(float3 &position, float3 ray) {
-    Body::Surface surface {};
-    for (int _ = 0; _ < constants::iterations; _++) {
-        surface = scene::SDF(position);
-        position += surface.SD * ray;
-        if (surface.SD < constants::precision::surface) break;
+// Next step length along the ray from the distance at the current position
+float scene::March::step(float distance) {
+    float radius = std::abs(distance);
+    this->failed = this->relaxation > 1.0f && radius + this->radius < this->length;
+    if (this->failed) {
+        // Return to the previous position and step plainly from there on
+        this->length -= this->relaxation * this->length;
+        this->relaxation = 1.0f;
     }
+    else this->length = this->relaxation * distance;
+    this->radius = radius;
+    return this->length;
+}
+
+// Steps never pass the segment the bound was taken over, inside the surface they go back like sphere tracing
+float scene::Segment::step(float3 position, float3 ray, float distance) {
+    if (distance <= 0.0f) return distance;
+    float segment = constants::segment::growth * std::max(distance, this->length);
+    float bound = scene::tree->lipschitz(position, ray, segment, distance + segment);
+    this->length = bound > 0.0f ? std::min(distance / bound, segment) : segment;
+    return this->length;
+}
+
+// Span of the ray past start inside the scene bounds, false when the ray misses them
+bool scene::clip(float3 position, float3 ray, float &near, float &far, float start) {
+    near = start;
+    far = constants::march::distance;
+    return scene::bounds.clip(position, ray, near, far);
+}
+
+// Misses come back with an infinite distance
+// A tape pruned to a region the ray stays in replaces the marched geometry
+Body::Surface scene::surface(float3 &position, float3 ray, float start, const Tape::Program *tape) {
+    float infinity = std::numeric_limits<float>::infinity();
+    Body::Surface surface = { .SD = infinity, .color = constants::march::background };
+    float near, far;
+    stats::add(stats::RAYS);
+    if (!scene::clip(position, ray, near, far, start)) return surface;
+
+    // The closest analytic hit ends the march of the remaining geometry
+    size_t index;
+    float3 origin = position;
+    float hit = scene::analytic.intersect(origin, ray, near, far, index);
+    far = std::min(far, hit);
+
+    Cull::Ray culling(scene::cull);
+    March march(scene::relaxation);
+    Segment segment;
+    bool segmented = scene::tracing == Tracing::SEGMENT;
+    position += near * ray;
+    float traveled = near;
+    int iteration = 0;
+    bool stale = false;     // The last step was a brick lookup, surface belongs to an earlier position
+    while (iteration < constants::iterations) {
+        iteration++;
+        // Far from the geometry the brick map bound is stepped plainly without an exact evaluation
+        float baked = scene::bricks.active ? scene::bricks.distance(position) : 0.0f;
+        bool exact = baked <= 0.0f;
+        stale = !exact;
+        if (exact && tape) surface = tape->SDF(position);
+        else if (exact) surface = cull.active ? culling.SDF(position) : scene::geometrySDF(position);
+        else {
+            stats::add(stats::LOOKUPS);
+            march = March(march.relaxation);
+        }
+        // Hits are resolved to a fraction of the sample footprint
+        float precision = std::max(constants::precision::surface, scene::footprint * traveled);
+        float step = !exact ? baked : segmented ? segment.step(position, ray, surface.SD) : march.step(surface.SD);
+        // Segment steps are empty as taken, relaxed ones only up to the distance
+        float reach = traveled + (exact && !segmented ? surface.SD : step);
+        position += step * ray;
+        traveled += step;
+        culling.advance(step);
+        if (march.failed) continue;
+        if (exact && surface.SD < precision) break;
+        if (reach > far) {
+            if (hit > far) surface.SD = infinity;
+            else {
+                position = origin + hit * ray;
+                surface = { .SD = 0.0f, .color = scene::analytic.primitives[index].color };
+            }
+            stale = false;
+            break;
+        }
+    }
+    // A march that ran out of iterations on a lookup step gets the distance at its last position
+    if (stale) surface = tape ? tape->SDF(position) : scene::geometrySDF(position);
+    stats::add(stats::ITERATIONS, iteration);
     return surface;
 }
 
-// Calculate shadow ray
-bool scene::shadow(Object::Light *light, float3 position, float3 normal) {
-    float3 ray = normalize(light->position - position);
+// Fraction of the light passing along the ray up to limit, 0 once a surface blocks it
+// With a penumbra the closest miss relative to its distance along the ray softens the result
+float scene::occlusion(float3 position, float3 ray, float limit) {
+    float near, far;
+    stats::add(stats::RAYS);
+    if (!scene::clip(position, ray, near, far)) return 1.0f;
+    far = std::min(far, limit);
+
+    // Any analytic hit blocks the light, with a penumbra primitives are marched with the tree to soften it
+    bool soft = constants::shadow::penumbra > 0.0f && scene::analytic.active;
+    size_t index;
+    if (!soft && scene::analytic.intersect(position, ray, near, far, index) <= far) return 0.0f;
+
+    Cull::Ray culling(scene::cull);
+    March march(scene::relaxation);
+    position += near * ray;
+    float traveled = near;
+    float light = 1.0f;
+    int iteration = 0;
+    while (iteration < constants::iterations) {
+        iteration++;
+        float baked = scene::bricks.active ? scene::bricks.distance(position) : 0.0f;
+        bool exact = baked <= 0.0f;
+        float distance = baked;
+        if (exact) distance = cull.active ? culling.distance(position) : scene::geometryDistance(position);
+        else {
+            stats::add(stats::LOOKUPS);
+            march = March(march.relaxation);
+        }
+        float primitive = soft ? scene::analytic.distance(position) : std::numeric_limits<float>::infinity();
+        distance = std::min(distance, primitive);
+        float step = exact ? march.step(distance) : distance;
+        if (!march.failed) {
+            if (distance < constants::precision::surface) break;
+            // The penumbra takes exact distances only, a baked bound would darken it
+            float clearance = exact ? distance : primitive;
+            if (constants::shadow::penumbra > 0.0f && traveled > 0.0f) {
+                light = std::min(light, constants::shadow::penumbra * clearance / traveled);
+                if (!exact && traveled + distance > far)
+                    light = std::min(light, constants::shadow::penumbra * scene::geometryDistance(position) / traveled);
+            }
+            if (traveled + distance > far) {
+                stats::add(stats::ITERATIONS, iteration);
+                return light;
+            }
+        }
+        position += step * ray;
+        traveled += step;
+        culling.advance(step);
+    }
+    stats::add(stats::ITERATIONS, iteration);
+    return 0.0f;
+}
+
+// March a cone of the given radius per unit of distance around the ray until it touches the surface,
+// every ray inside the cone is empty up to the returned distance when it is empty up to start
+float scene::cone(float3 position, float3 ray, float slope, float start) {
+    float near, far;
+    if (!scene::clip(position, ray, near, far)) return start;
+
+    float traveled = start;
+    int iteration = 0;
+    while (iteration < constants::iterations && traveled <= far) {
+        iteration++;
+        float gap = scene::distance(position + traveled * ray) - slope * traveled;
+        if (gap < constants::precision::surface) break;
+        traveled += gap / (1.0f + slope);
+    }
+    stats::add(stats::CONES, iteration);
+    return traveled;
+}
+
+// Fraction of the light reaching the surface, 0 in full shadow
+float scene::shadow(Object::Light *light, float3 position, float3 normal) {
     position += normal * (constants::precision::surface + constants::precision::offset);
-    scene::surface(position, ray);
-    return dot(light->position - position, ray) > 0;
+    float3 direction = light->position - position;
+    return scene::occlusion(position, normalize(direction), length(direction));
 }
 
 // Calculate the lighting at the surface
@@ -54,38 +256,40 @@ float scene::lighting(float3 position, float3 normal) {
     float lighting = 0.0f;
     for (uint idx = 0; idx < lights.size(); idx++) {
         Object::Light *light = lights[idx];
-        if (!scene::shadow(light, position, normal))
-            lighting += dot(normal, normalize(light->position - position));
+        float visible = scene::shadow(light, position, normal);
+        if (visible > 0.0f)
+            lighting += visible * dot(normal, normalize(light->position - position));
     }
     lighting = clamp(lighting, constants::saturation, 1.0f);
     return lighting;
 }
 
-// Calculate SDF from scene tree
+// Calculate SDF from compiled scene tree and analytic primitives
 Body::Surface scene::SDF(float3 position) {
-    return tree->SDF(position);
+    Body::Surface surface = scene::geometrySDF(position);
+    if (!analytic.active) return surface;
+    Body::Surface primitive = analytic.SDF(position);
+    return primitive.SD < surface.SD ? primitive : surface;
 }
 
-// Calculate gradient of scene SDF
-float3 scene::grad(float3 p) {
-    static const float h = 1e-3f;
-    float3 dx = float3(h, 0.0f, 0.0f);
-    float3 dy = float3(0.0f, h, 0.0f);
-    float3 dz = float3(0.0f, 0.0f, h);
-
-    Body::Surface dxl = scene::SDF(p + dx);
-    Body::Surface dxr = scene::SDF(p - dx);
-    float dfdx = dxl.SD - dxr.SD;
-
-    Body::Surface dyl = scene::SDF(p + dy);
-    Body::Surface dyr = scene::SDF(p - dy);
-    float dfdy = dyl.SD - dyr.SD;
+// Calculate distance only SDF from compiled scene tree and analytic primitives
+float scene::distance(float3 position) {
+    float distance = scene::geometryDistance(position);
+    if (!analytic.active) return distance;
+    return std::min(distance, analytic.distance(position));
+}
 
-    Body::Surface dzl = scene::SDF(p + dz);
-    Body::Surface dzr = scene::SDF(p - dz);
-    float dfdz = dzl.SD - dzr.SD;
+// Calculate SDF together with its gradient in a single pass
+Tape::Dual scene::dual(float3 position) {
+    Tape::Dual dual = bvh.active ? bvh.gradient(position) : program.gradient(position);
+    if (!analytic.active) return dual;
+    Tape::Dual primitive = analytic.gradient(position);
+    return primitive.SD < dual.SD ? primitive : dual;
+}
 
-    return float3(dfdx, dfdy, dfdz) / (2 * h);
+// Calculate gradient of scene SDF
+float3 scene::grad(float3 p) {
+    return scene::dual(p).grad;
 }
 
 // Load scene objects from path
@@ -96,6 +300,9 @@ void scene::load(const char *path) {
     std::ifstream file(path);
     std::string line;
 
+    // Bodies go to the innermost open Repeat or Mirror block
+    std::vector<Body::List*> lists = { scene::tree };
+
     float3 color = float3(1.0f);
     while (std::getline(file, line)) {
         std::istringstream input(line);
@@ -117,14 +324,6 @@ void scene::load(const char *path) {
             input >> size.x >> size.y >> size.z;
             obj = new Body::Box(position, size, color);
         }
-        else if (cmd == "Bounds") {
-            float size;
-            input >> size;
-            Body::Box *box = new Body::Box(float3(0.0f), float3(size), float3(0.0f));
-            Body::List *list = new Body::List(Body::Mode::COMPLEMENT);
-            list->append(box);
-            obj = list;
-        }
         else if (cmd == "Cross") {
             float3 position, size;
             input >> position.x >> position.y >> position.z;
@@ -141,17 +340,49 @@ void scene::load(const char *path) {
             float3 position;
             float size;
             int iterations;
-            input >> position.x >> position.y >> position.z >> size >> iterations;
-            obj = Body::MengerSponge(position, size, iterations, color);
+            std::string form;
+            input >> position.x >> position.y >> position.z >> size >> iterations >> form;
+            if (form == "Legacy")
+                obj = Body::MengerSponge(position, size, iterations, color);
+            else
+                obj = new Body::Menger(position, size, iterations, color);
+        }
+        else if (cmd == "Repeat") {
+            float3 position, period;
+            int3 count;
+            input >> position.x >> position.y >> position.z;
+            input >> period.x >> period.y >> period.z;
+            input >> count.x >> count.y >> count.z;
+            obj = new Body::Repeat(position, period, count);
+        }
+        else if (cmd == "Mirror") {
+            float3 position, normal;
+            input >> position.x >> position.y >> position.z;
+            input >> normal.x >> normal.y >> normal.z;
+            obj = new Body::Mirror(position, normal);
         }
         else isBody = false;
 
         if (isBody) {
-            scene::tree->append(obj);
+            lists.back()->append(obj);
+            if (obj->type == Body::Type::REPEAT || obj->type == Body::Type::MIRROR)
+                lists.push_back(static_cast<Body::List*>(obj));
+            continue;
+        }
+
+        if (cmd == "End") {
+            if (lists.size() > 1) lists.pop_back();
+            else std::cout << "[Error] Scene End without open block" << std::endl;
             continue;
         }
 
-        if (cmd == "Light") {
+        // Scene bounds clip rays instead of being marched
+        if (cmd == "Bounds") {
+            float size;
+            input >> size;
+            scene::bounds = { .lower = float3(-size), .upper = float3(size) };
+        }
+        else if (cmd == "Light") {
             float3 position;
             input >> position.x >> position.y >> position.z;
             Object::Light *light = new Object::Light(position);
@@ -187,4 +418,68 @@ void scene::load(const char *path) {
 
     // Update camera transform
     scene::camera->update();
+
+    // Angle between neighbouring samples of the rendered image
+    float angle = scene::camera->focal / (constants::width * constants::SSAA::kernel);
+    scene::footprint = constants::precision::footprint * angle;
+
+    // Simplify the tree before anything is built from it
+    if (constants::csg::enabled) {
+        size_t nodes = CSG::count(scene::tree);
+        CSG::optimize(scene::tree);
+        std::cout << "Scene tree nodes:\t\t" << nodes << " -> " << CSG::count(scene::tree) << std::endl;
+    }
+
+    // Top-level spheres and boxes are intersected in closed form instead of being marched
+    if (constants::analytic::enabled && scene::tree->mode == Body::Mode::UNION) {
+        scene::analytic.build(scene::tree);
+        std::cout << "Analytic primitives:\t\t" << scene::analytic.primitives.size() << std::endl;
+    }
+
+    // Bound lists, pool same-type bodies and flatten the tree for evaluation
+    scene::tree->fit();
+    scene::tree->pack();
+    Body::Bounds geometry = Body::Bounds::merge(scene::tree->bounds(), scene::analytic.bounds());
+    scene::bounds = Body::Bounds::intersect(scene::bounds, geometry);
+    Tape::compile(scene::tree, scene::program);
+
+    // Accelerate large top-level unions
+    bool large = scene::tree->bodies.size() >= constants::bvh::threshold;
+    if (constants::bvh::enabled && large && scene::tree->mode == Body::Mode::UNION)
+        scene::bvh.build(scene::tree);
+
+    // Without a BVH marching rays skip top-level bodies they can't reach yet
+    bool many = scene::tree->bodies.size() >= constants::cull::threshold;
+    if (constants::cull::enabled && many && !scene::bvh.active && scene::tree->mode == Body::Mode::UNION)
+        scene::cull.build(scene::tree);
+}
+
+// Bake the brick map of the marched geometry, it is read back from the cache while the scene stays the same
+void scene::bake() {
+    Body::Bounds geometry = scene::tree->bounds();
+    bool finite = true;
+    for (int axis = 0; axis < 3; axis++)
+        finite = finite && std::isfinite(geometry.lower[axis]) && std::isfinite(geometry.upper[axis]);
+    if (!finite) {
+        std::cout << "[Error] Brick map needs bounded geometry" << std::endl;
+        return;
+    }
+
+    // A tree too deep for the tape has no code to key the cache by, it is baked every run
+    if (scene::program.tree) {
+        scene::bricks.bake(scene::program, geometry);
+        std::cout << "Brick map bricks:\t\t" << scene::bricks.fine.size() / Brick::samples << std::endl;
+        return;
+    }
+
+    uint64_t key = Brick::key(scene::program, geometry);
+    char path[256];
+    std::snprintf(path, sizeof(path), "%s_%016llx.bin", constants::brick::cache, (unsigned long long)key);
+    bool cached = scene::bricks.load(path, key, geometry);
+    if (!cached) {
+        scene::bricks.bake(scene::program, geometry);
+        scene::bricks.save(path, key);
+    }
+    std::cout << "Brick map bricks:\t\t" << scene::bricks.fine.size() / Brick::samples
+              << (cached ? " (cached)" : "") << std::endl;
 }
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include <iostream>
+#include <vector>
+#include <omp.h>
+
+#include "stats.h"
+
+namespace stats {
+    // Every thread counts into its own cache line, the padding keeps neighbour slots off it
+    // whatever the alignment of the allocation
+    struct Slot {
+        size_t values[COUNTERS];
+        char padding[64];
+    };
+
+    // One slot per thread of the largest team at the last reset
+    static std::vector<Slot> slots(omp_get_max_threads(), Slot());
+    // Threads of a larger team share this one and add atomically
+    static Slot overflow;
+
+    void add(Counter counter, size_t amount) {
+        size_t thread = omp_get_thread_num();
+        if (thread < slots.size()) slots[thread].values[counter] += amount;
+        else {
+            #pragma omp atomic
+            overflow.values[counter] += amount;
+        }
+    }
+
+    size_t total(Counter counter) {
+        size_t total = overflow.values[counter];
+        for (const Slot &slot : slots)
+            total += slot.values[counter];
+        return total;
+    }
+
+    void reset() {
+        slots.assign(omp_get_max_threads(), Slot());
+        overflow = Slot();
+    }
+
+    // Print the counters gathered since the last report
+    void report(const char *name) {
+        std::cout << "Limit exits (" << name << "):\t\t" << total(EXITS)
+                  << " lists, " << total(SKIPPED) << " children skipped" << std::endl;
+        std::cout << "Culled evaluations (" << name << "):\t" << total(CULLED) << std::endl;
+        size_t rays = total(RAYS);
+        if (rays) std::cout << "Iterations per ray (" << name << "):\t"
+                            << double(total(ITERATIONS)) / rays << std::endl;
+        size_t lookups = total(LOOKUPS);
+        if (rays && lookups) std::cout << "Brick lookups per ray (" << name << "):\t"
+                                       << double(lookups) / rays << std::endl;
+        size_t pixels = total(PIXELS);
+        if (pixels) std::cout << "Evaluations per pixel (" << name << "):\t"
+                              << double(total(ITERATIONS) + total(CONES)) / pixels << std::endl;
+        reset();
+    }
+}
@@ -0,0 +1,1164 @@
+#include <LiteMath.h>
+#include <cmath>
+#include <limits>
+#include <iostream>
+
+#include "constants.h"
+#include "stats.h"
+#include "body.h"
+#include "tape.h"
+
+using namespace LiteMath;
+
+namespace Tape {
+    static Fold fold(Body::Mode mode) {
+        return static_cast<Fold>(static_cast<uint>(mode) + 1);
+    }
+
+    /// Compiler ///
+    static bool bounded(const Body::Bounds &bounds) {
+        for (int axis = 0; axis < 3; axis++) {
+            if (std::isfinite(bounds.lower[axis]) || std::isfinite(bounds.upper[axis]))
+                return true;
+        }
+        return false;
+    }
+
+    // Whether the list or a list below it can stop early at the limit given by its parent
+    static bool limited(Body::Base *body) {
+        if (!constants::shortcut::enabled || !Body::composite(body->type)) return false;
+
+        Body::List *list = static_cast<Body::List*>(body);
+        const std::vector<Body::Base*> &bodies = list->packed ? list->loose : list->bodies;
+        bool exits = list->mode == Body::Mode::INTERSECTION || list->mode == Body::Mode::DIFFERENCE;
+        if (exits && bodies.size() + list->pools.size() > 1) return true;
+
+        for (Body::Base *child : bodies) {
+            if (limited(child)) return true;
+        }
+        return false;
+    }
+
+    static void limit(Program &program, Fold fold) {
+        Instruction instruction {};
+        instruction.op = Op::LIMIT;
+        instruction.fold = fold;
+        program.code.push_back(instruction);
+    }
+
+    // Transformed lists evaluate their children at a moved position
+    static bool enter(Body::List *list, Program &program) {
+        Instruction instruction {};
+        switch (list->type) {
+            case Body::Type::REPEAT:
+            {
+                Body::Repeat *obj = static_cast<Body::Repeat*>(list);
+                instruction.op = Op::REPEAT;
+                instruction.position = obj->position;
+                instruction.size = obj->period;
+                instruction.count = float3(obj->count.x, obj->count.y, obj->count.z);
+                break;
+            }
+
+            case Body::Type::MIRROR:
+            {
+                Body::Mirror *obj = static_cast<Body::Mirror*>(list);
+                instruction.op = Op::MIRROR;
+                instruction.position = obj->position;
+                instruction.size = obj->normal;
+                break;
+            }
+
+            default: return false;
+        }
+
+        program.code.push_back(instruction);
+        return true;
+    }
+
+    static void check(Program &program, size_t left, std::vector<size_t> &checks) {
+        Instruction instruction {};
+        instruction.op = Op::EXIT;
+        instruction.count = float3(left, 0.0f, 0.0f);
+        checks.push_back(program.code.size());
+        program.code.push_back(instruction);
+    }
+
+    static uint material(Program &program, float3 color) {
+        program.materials.push_back(color);
+        return program.materials.size() - 1;
+    }
+
+    static void emit(Body::Base *body, Fold fold, Program &program, size_t depth, size_t frames) {
+        Instruction instruction {};
+        instruction.fold = fold;
+        if (fold == Fold::PUSH) depth++;
+        program.depth = max(program.depth, depth);
+
+        switch (body->type) {
+            case Body::Type::SPHERE:
+            {
+                Body::Sphere *obj = static_cast<Body::Sphere*>(body);
+                instruction.op = Op::SPHERE;
+                instruction.position = obj->position;
+                instruction.size = float3(obj->radius);
+                instruction.material = material(program, obj->color);
+                break;
+            }
+
+            case Body::Type::BOX:
+            {
+                Body::Box *obj = static_cast<Body::Box*>(body);
+                instruction.op = Op::BOX;
+                instruction.position = obj->position;
+                instruction.size = obj->size / 2;
+                instruction.material = material(program, obj->color);
+                break;
+            }
+
+            case Body::Type::CROSS:
+            {
+                Body::Cross *obj = static_cast<Body::Cross*>(body);
+                instruction.op = Op::CROSS;
+                instruction.position = obj->position;
+                instruction.size = obj->size / 2;
+                instruction.material = material(program, obj->color);
+                break;
+            }
+
+            case Body::Type::MENGER:
+            {
+                Body::Menger *obj = static_cast<Body::Menger*>(body);
+                instruction.op = Op::MENGER;
+                instruction.position = obj->position;
+                instruction.size = float3(obj->size, obj->iterations, 0.0f);
+                instruction.material = material(program, obj->color);
+                break;
+            }
+
+            case Body::Type::LIST:
+            case Body::Type::REPEAT:
+            case Body::Type::MIRROR:
+            {
+                Body::List *list = static_cast<Body::List*>(body);
+                const std::vector<Body::Base*> &bodies = list->packed ? list->loose : list->bodies;
+                if (bodies.empty()) {
+                    instruction.op = Op::EMPTY;
+                    break;
+                }
+
+                // Lists folded into a parent get their own stack slot, bounded ones may be skipped whole
+                if (fold != Fold::PUSH) {
+                    size_t guard = program.code.size();
+                    bool guarded = (fold == Fold::UNION || fold == Fold::DIFFERENCE) && bounded(list->bound);
+                    if (guarded) {
+                        Instruction bound {};
+                        bound.op = Op::BOUND;
+                        bound.fold = fold;
+                        bound.position = list->bound.lower;
+                        bound.size = list->bound.upper;
+                        program.code.push_back(bound);
+                    }
+
+                    if (limited(list)) limit(program, fold);
+                    emit(list, Fold::PUSH, program, depth, frames);
+                    instruction.op = Op::MERGE;
+                    program.code.push_back(instruction);
+
+                    if (guarded)
+                        program.code[guard].skip = program.code.size() - 1 - guard;
+                    return;
+                }
+
+                bool entered = enter(list, program);
+                if (entered) frames++;
+                program.frames = max(program.frames, frames);
+
+                // The first child of a complement is negated, it has no limit
+                if (list->mode == Body::Mode::COMPLEMENT && limited(bodies[0]))
+                    limit(program, Fold::PUSH);
+                emit(bodies[0], Fold::PUSH, program, depth - 1, frames);
+                if (list->mode == Body::Mode::COMPLEMENT) {
+                    Instruction negate {};
+                    negate.op = Op::NEGATE;
+                    program.code.push_back(negate);
+                }
+
+                // Intersections and differences check their limit before every following child
+                bool exits = constants::shortcut::enabled &&
+                    (list->mode == Body::Mode::INTERSECTION || list->mode == Body::Mode::DIFFERENCE);
+                std::vector<size_t> checks;
+                size_t left = bodies.size() - 1;
+                for (Body::Pool *pool : list->pools)
+                    left += pool->count;
+
+                for (size_t idx = 1; idx < bodies.size(); idx++) {
+                    if (exits) check(program, left, checks);
+                    emit(bodies[idx], Tape::fold(list->mode), program, depth, frames);
+                    left--;
+                }
+
+                for (Body::Pool *pool : list->pools) {
+                    if (exits) check(program, left, checks);
+                    left -= pool->count;
+
+                    Instruction reduce {};
+                    reduce.op = Op::POOL;
+                    reduce.fold = Tape::fold(list->mode);
+                    reduce.pool = pool;
+                    reduce.material = program.materials.size();
+                    program.materials.insert(program.materials.end(), pool->colors.begin(), pool->colors.end());
+                    program.code.push_back(reduce);
+                }
+
+                // Exits land on the last instruction of the list, a transform is still left
+                for (size_t check : checks)
+                    program.code[check].skip = program.code.size() - 1 - check;
+
+                if (entered) {
+                    Instruction leave {};
+                    leave.op = Op::LEAVE;
+                    program.code.push_back(leave);
+                }
+                return;
+            }
+
+            default:
+            {
+                instruction.op = Op::EMPTY;
+                break;
+            }
+        }
+
+        program.code.push_back(instruction);
+    }
+
+    // A tree too deep for the interpreter stacks keeps no code and is evaluated through its bodies
+    void compile(Body::Base *tree, Program &program) {
+        program.code.clear();
+        program.materials.assign(1, float3(0.0f));
+        program.depth = 0;
+        program.frames = 0;
+        program.tree = nullptr;
+        emit(tree, Fold::PUSH, program, 0, 0);
+
+        if (program.depth > constants::tape::stackMax || program.frames > constants::tape::stackMax) {
+            std::cout << "[Error] Scene tree is too deep for the SDF tape, evaluating the tree" << std::endl;
+            program.code.clear();
+            program.materials.assign(1, float3(0.0f));
+            program.depth = 0;
+            program.frames = 0;
+            program.tree = tree;
+        }
+    }
+
+    /// Interpreter ///
+    static inline float sphere(const Instruction &ins, float3 position) {
+        return length(ins.position - position) - ins.size.x;
+    }
+
+    static inline float box(const Instruction &ins, float3 position) {
+        float3 distances = abs(position - ins.position) - ins.size;
+        return max(max(distances.x, distances.y), distances.z);
+    }
+
+    static inline float cross(const Instruction &ins, float3 position) {
+        float3 distances = abs(position - ins.position) - ins.size;
+        float dmin = min(min(distances.x, distances.y), distances.z);
+        float dmax = max(max(distances.x, distances.y), distances.z);
+        return distances.x + distances.y + distances.z - dmin - dmax;
+    }
+
+    static inline float menger(const Instruction &ins, float3 position) {
+        float3 local = position - ins.position;
+        float3 distances = abs(local) - ins.size.x / 2;
+        float distance = max(max(distances.x, distances.y), distances.z);
+
+        float cell = ins.size.x;
+        int iterations = ins.size.y;
+        for (int level = 0; level < iterations; level++) {
+            float3 folded = local - cell * float3(
+                std::floor(local.x / cell + 0.5f),
+                std::floor(local.y / cell + 0.5f),
+                std::floor(local.z / cell + 0.5f));
+            float3 holes = abs(folded) - cell / 6;
+            float dmin = min(min(holes.x, holes.y), holes.z);
+            float dmax = max(max(holes.x, holes.y), holes.z);
+            float cross = holes.x + holes.y + holes.z - dmin - dmax;
+            distance = max(distance, -cross);
+            cell /= 3;
+        }
+        return distance;
+    }
+
+    static inline float3 repeat(const Instruction &ins, float3 position) {
+        float3 local = position - ins.position;
+        for (int axis = 0; axis < 3; axis++) {
+            float period = ins.size[axis];
+            if (period == 0.0f) continue;
+
+            float count = ins.count[axis];
+            float half = count > 0.0f ? (count - 1) / 2 : 0.0f;
+            float cell = std::floor(local[axis] / period + half + 0.5f);
+            if (count > 0.0f) cell = clamp(cell, 0.0f, count - 1);
+            local[axis] -= period * (cell - half);
+        }
+        return local + ins.position;
+    }
+
+    static inline float3 mirror(const Instruction &ins, float3 position) {
+        float height = dot(position - ins.position, ins.size);
+        return position - 2 * min(height, 0.0f) * ins.size;
+    }
+
+    template <Op O>
+    static inline float distance(const Instruction &ins, float3 position) {
+        switch (O) {
+            case Op::SPHERE:    return sphere(ins, position);
+            case Op::BOX:       return box(ins, position);
+            case Op::CROSS:     return cross(ins, position);
+            case Op::MENGER:    return menger(ins, position);
+            default: break;
+        }
+        return std::numeric_limits<float>::infinity();
+    }
+
+    /// Gradients ///
+    // Max-norm shapes are flat along the axis of the deciding component
+    static inline float3 facing(float3 local, int axis) {
+        float3 grad = float3(0.0f);
+        grad[axis] = local[axis] < 0.0f ? -1.0f : 1.0f;
+        return grad;
+    }
+
+    static inline int largest(float3 vector) {
+        int axis = 0;
+        if (vector.y > vector[axis]) axis = 1;
+        if (vector.z > vector[axis]) axis = 2;
+        return axis;
+    }
+
+    static inline int median(float3 vector) {
+        int lower = 0, upper = 0;
+        for (int axis = 1; axis < 3; axis++) {
+            if (vector[axis] < vector[lower]) lower = axis;
+            if (vector[axis] >= vector[upper]) upper = axis;
+        }
+        return 3 - lower - upper;
+    }
+
+    static inline float sphere(float3 position, float3 center, float radius, float3 &grad) {
+        float3 offset = position - center;
+        float distance = length(offset);
+        grad = distance > 0.0f ? offset / distance : float3(0.0f, 1.0f, 0.0f);
+        return distance - radius;
+    }
+
+    static inline float box(float3 position, float3 center, float3 size, float3 &grad) {
+        float3 local = position - center;
+        float3 distances = abs(local) - size;
+        grad = facing(local, largest(distances));
+        return max(max(distances.x, distances.y), distances.z);
+    }
+
+    static inline float cross(float3 position, float3 center, float3 size, float3 &grad) {
+        float3 local = position - center;
+        float3 distances = abs(local) - size;
+        grad = facing(local, median(distances));
+        float dmin = min(min(distances.x, distances.y), distances.z);
+        float dmax = max(max(distances.x, distances.y), distances.z);
+        return distances.x + distances.y + distances.z - dmin - dmax;
+    }
+
+    // Gradient of the box or of the level cross deciding the distance
+    static inline float menger(float3 position, float3 center, float size, int iterations, float3 &grad) {
+        float3 local = position - center;
+        float3 distances = abs(local) - size / 2;
+        float distance = max(max(distances.x, distances.y), distances.z);
+        grad = facing(local, largest(distances));
+
+        float cell = size;
+        for (int level = 0; level < iterations; level++) {
+            float3 folded = local - cell * float3(
+                std::floor(local.x / cell + 0.5f),
+                std::floor(local.y / cell + 0.5f),
+                std::floor(local.z / cell + 0.5f));
+            float3 holes = abs(folded) - cell / 6;
+            float dmin = min(min(holes.x, holes.y), holes.z);
+            float dmax = max(max(holes.x, holes.y), holes.z);
+            float cross = holes.x + holes.y + holes.z - dmin - dmax;
+            if (-cross > distance) {
+                distance = -cross;
+                grad = -facing(folded, median(holes));
+            }
+            cell /= 3;
+        }
+        return distance;
+    }
+
+    template <Op O>
+    static inline float gradient(const Instruction &ins, float3 position, float3 &grad) {
+        switch (O) {
+            case Op::SPHERE:    return sphere(position, ins.position, ins.size.x, grad);
+            case Op::BOX:       return box(position, ins.position, ins.size, grad);
+            case Op::CROSS:     return cross(position, ins.position, ins.size, grad);
+            case Op::MENGER:    return menger(position, ins.position, ins.size.x, ins.size.y, grad);
+            default: break;
+        }
+        grad = float3(0.0f);
+        return std::numeric_limits<float>::infinity();
+    }
+
+    /// Values ///
+    // Stack values of the interpreter variants, materials are only tracked when shading
+    struct Distance {
+        float SD;
+    };
+
+    struct Hit {
+        float SD;
+        uint material;
+    };
+
+    static inline void set(Distance &value, float SD, uint material) {
+        value.SD = SD;
+    }
+
+    static inline void set(Hit &value, float SD, uint material) {
+        value.SD = SD;
+        value.material = material;
+    }
+
+    static inline void set(Dual &value, float SD, uint material) {
+        value.SD = SD;
+        value.grad = float3(0.0f);
+    }
+
+    template <Op O>
+    static inline void primitive(Distance &value, const Instruction &ins, float3 position) {
+        value.SD = distance<O>(ins, position);
+    }
+
+    template <Op O>
+    static inline void primitive(Hit &value, const Instruction &ins, float3 position) {
+        value.SD = distance<O>(ins, position);
+        value.material = ins.material;
+    }
+
+    template <Op O>
+    static inline void primitive(Dual &value, const Instruction &ins, float3 position) {
+        value.SD = gradient<O>(ins, position, value.grad);
+    }
+
+    static inline void negate(Distance &value) {
+        value.SD = -value.SD;
+    }
+
+    static inline void negate(Hit &value) {
+        value.SD = -value.SD;
+    }
+
+    static inline void negate(Dual &value) {
+        value.SD = -value.SD;
+        value.grad = -value.grad;
+    }
+
+    static inline void reduce(Distance &value, const Body::Pool &pool, float3 position, bool maximum, float limit, uint material) {
+        value.SD = pool.distance(position, maximum, limit);
+    }
+
+    static inline void reduce(Hit &value, const Body::Pool &pool, float3 position, bool maximum, float limit, uint material) {
+        size_t index;
+        value.SD = pool.nearest(position, maximum, limit, index);
+        value.material = material + index;
+    }
+
+    static inline void reduce(Dual &value, const Body::Pool &pool, float3 position, bool maximum, float limit, uint material) {
+        size_t index;
+        value.SD = pool.nearest(position, maximum, limit, index);
+
+        float3 center = float3(pool.x[index], pool.y[index], pool.z[index]);
+        switch (pool.type) {
+            case Body::Type::SPHERE:
+                sphere(position, center, pool.radius[index], value.grad); break;
+            case Body::Type::BOX:
+                box(position, center, float3(pool.sx[index], pool.sy[index], pool.sz[index]), value.grad); break;
+            case Body::Type::CROSS:
+                cross(position, center, float3(pool.sx[index], pool.sy[index], pool.sz[index]), value.grad); break;
+            default:
+                value.grad = float3(0.0f); break;
+        }
+    }
+
+    // Leaving a transformed list, only mirrors turn the gradient of its value
+    static inline void leave(Distance &value, const Instruction &enter, float3 position) {}
+
+    static inline void leave(Hit &value, const Instruction &enter, float3 position) {}
+
+    static inline void leave(Dual &value, const Instruction &enter, float3 position) {
+        if (enter.op != Op::MIRROR || dot(position - enter.position, enter.size) >= 0.0f) return;
+        value.grad -= 2 * dot(value.grad, enter.size) * enter.size;
+    }
+
+    // Limit of a list folded into the top value, see Body::List::SDF
+    static inline float limit(Fold fold, float top, float limit) {
+        switch (fold) {
+            case Fold::UNION:           return min(top, limit);
+            case Fold::INTERSECTION:    return limit;
+            case Fold::DIFFERENCE:      return -top;
+            default: break;
+        }
+        return std::numeric_limits<float>::infinity();
+    }
+
+    // Pools stop once the body they fold passes the limit of their list
+    static inline float cutoff(Fold fold, float limit) {
+        float infinity = std::numeric_limits<float>::infinity();
+        switch (fold) {
+            case Fold::INTERSECTION:    return limit;
+            case Fold::DIFFERENCE:      return -limit;
+            case Fold::COMPLEMENT:      return infinity;
+            default: break;
+        }
+        return -infinity;
+    }
+
+    template <typename V>
+    static inline void apply(V *stack, int &top, Fold fold, V value) {
+        switch (fold) {
+            case Fold::PUSH:
+            {
+                stack[++top] = value;
+                break;
+            }
+
+            case Fold::UNION:
+            {
+                if (value.SD < stack[top].SD) stack[top] = value;
+                break;
+            }
+
+            case Fold::COMPLEMENT:
+            {
+                negate(value);
+                if (value.SD < stack[top].SD) stack[top] = value;
+                break;
+            }
+
+            case Fold::INTERSECTION:
+            {
+                if (value.SD > stack[top].SD) stack[top] = value;
+                break;
+            }
+
+            case Fold::DIFFERENCE:
+            {
+                negate(value);
+                if (value.SD > stack[top].SD) stack[top] = value;
+                break;
+            }
+        }
+    }
+
+    template <typename V>
+    static V evaluate(const Program &program, float3 point, float bound) {
+        V stack[constants::tape::stackMax];
+        float limits[constants::tape::stackMax];
+        int top = -1;
+        limits[0] = bound;
+
+        float3 frames[constants::tape::stackMax];
+        const Instruction *entered[constants::tape::stackMax];
+        int frame = -1;
+        float3 position = point;
+
+        const Instruction *ins = program.code.data();
+        const Instruction *end = ins + program.code.size();
+        for (; ins < end; ins++) {
+            V value;
+            switch (ins->op) {
+                case Op::SPHERE:
+                    primitive<Op::SPHERE>(value, *ins, position); break;
+                case Op::BOX:
+                    primitive<Op::BOX>(value, *ins, position); break;
+                case Op::CROSS:
+                    primitive<Op::CROSS>(value, *ins, position); break;
+                case Op::MENGER:
+                    primitive<Op::MENGER>(value, *ins, position); break;
+                case Op::EMPTY:
+                    set(value, std::numeric_limits<float>::infinity(), ins->material); break;
+                case Op::NEGATE:
+                    negate(stack[top]); continue;
+                case Op::MERGE:
+                    value = stack[top--]; break;
+                case Op::POOL:
+                {
+                    // Union and difference fold the closest pooled body, the other modes the farthest
+                    bool maximum = ins->fold == Fold::INTERSECTION || ins->fold == Fold::COMPLEMENT;
+                    bool bounded = constants::shortcut::enabled && (ins->fold == Fold::INTERSECTION || ins->fold == Fold::DIFFERENCE);
+                    float limit = bounded ? cutoff(ins->fold, limits[top]) : cutoff(ins->fold, std::numeric_limits<float>::infinity());
+                    reduce(value, *ins->pool, position, maximum, limit, ins->material);
+                    break;
+                }
+                case Op::BOUND:
+                {
+                    float3 distances = max(ins->position - position, position - ins->size);
+                    float distance = max(max(distances.x, distances.y), distances.z);
+                    float limit = ins->fold == Fold::UNION ? stack[top].SD : -stack[top].SD;
+                    if (distance >= limit) ins += ins->skip;
+                    continue;
+                }
+                case Op::LIMIT:
+                {
+                    float infinity = std::numeric_limits<float>::infinity();
+                    limits[top + 1] = ins->fold == Fold::PUSH ? infinity : limit(ins->fold, stack[top].SD, limits[top]);
+                    continue;
+                }
+                case Op::EXIT:
+                {
+                    if (stack[top].SD < limits[top]) continue;
+                    stats::add(stats::EXITS);
+                    stats::add(stats::SKIPPED, ins->count.x);
+                    ins += ins->skip;
+                    continue;
+                }
+                case Op::REPEAT:
+                    entered[++frame] = ins; frames[frame] = position; position = repeat(*ins, position); continue;
+                case Op::MIRROR:
+                    entered[++frame] = ins; frames[frame] = position; position = mirror(*ins, position); continue;
+                case Op::LEAVE:
+                    leave(stack[top], *entered[frame], frames[frame]); position = frames[frame--]; continue;
+            }
+            apply(stack, top, ins->fold, value);
+        }
+
+        return stack[0];
+    }
+
+    /// Tree fallback ///
+    // Central differences of the tree, it has no dual form
+    static Dual treeGradient(Body::Base *tree, float3 position) {
+        static const float h = 1e-3f;
+        float3 dx = float3(h, 0.0f, 0.0f);
+        float3 dy = float3(0.0f, h, 0.0f);
+        float3 dz = float3(0.0f, 0.0f, h);
+
+        float dfdx = tree->SDF(position + dx).SD - tree->SDF(position - dx).SD;
+        float dfdy = tree->SDF(position + dy).SD - tree->SDF(position - dy).SD;
+        float dfdz = tree->SDF(position + dz).SD - tree->SDF(position - dz).SD;
+        return { .SD = tree->SDF(position).SD, .grad = float3(dfdx, dfdy, dfdz) / (2 * h) };
+    }
+
+    static float3 lane(const simd::vfloat3 &position, int idx) {
+        float x[simd::lanes], y[simd::lanes], z[simd::lanes];
+        simd::store(x, position.x);
+        simd::store(y, position.y);
+        simd::store(z, position.z);
+        return float3(x[idx], y[idx], z[idx]);
+    }
+
+    Body::Surface Program::SDF(float3 position, float limit) const {
+        if (this->tree) return this->tree->SDF(position);
+        Hit hit = evaluate<Hit>(*this, position, limit);
+        return { .SD = hit.SD, .color = this->materials[hit.material] };
+    }
+
+    float Program::distance(float3 position, float limit) const {
+        if (this->tree) return this->tree->SDF(position).SD;
+        return evaluate<Distance>(*this, position, limit).SD;
+    }
+
+    Dual Program::gradient(float3 position, float limit) const {
+        if (this->tree) return treeGradient(this->tree, position);
+        return evaluate<Dual>(*this, position, limit);
+    }
+
+    /// Packet interpreter ///
+    static inline simd::vfloat3 broadcast(float3 vector) {
+        return simd::set(vector.x, vector.y, vector.z);
+    }
+
+    static inline simd::vfloat sphere(const simd::vfloat3 &position, float3 center, float radius) {
+        return simd::sub(simd::length(simd::sub(broadcast(center), position)), simd::set(radius));
+    }
+
+    static inline simd::vfloat box(const simd::vfloat3 &position, float3 center, float3 size) {
+        simd::vfloat3 distances = simd::sub(simd::abs(simd::sub(position, broadcast(center))), broadcast(size));
+        return simd::max(simd::max(distances.x, distances.y), distances.z);
+    }
+
+    static inline simd::vfloat cross(const simd::vfloat3 &position, float3 center, float3 size) {
+        simd::vfloat3 distances = simd::sub(simd::abs(simd::sub(position, broadcast(center))), broadcast(size));
+        simd::vfloat dmin = simd::min(simd::min(distances.x, distances.y), distances.z);
+        simd::vfloat dmax = simd::max(simd::max(distances.x, distances.y), distances.z);
+        simd::vfloat sum = simd::add(simd::add(distances.x, distances.y), distances.z);
+        return simd::sub(simd::sub(sum, dmin), dmax);
+    }
+
+    static inline simd::vfloat fold(simd::vfloat coordinate, simd::vfloat cell, simd::vfloat half) {
+        simd::vfloat index = simd::floor(simd::add(simd::div(coordinate, cell), half));
+        return simd::sub(coordinate, simd::mul(cell, index));
+    }
+
+    static inline simd::vfloat menger(const simd::vfloat3 &position, float3 center, float size, int iterations) {
+        simd::vfloat3 local = simd::sub(position, broadcast(center));
+        simd::vfloat3 distances = simd::sub(simd::abs(local), simd::set(size / 2, size / 2, size / 2));
+        simd::vfloat distance = simd::max(simd::max(distances.x, distances.y), distances.z);
+
+        simd::vfloat half = simd::set(0.5f);
+        float cell = size;
+        for (int level = 0; level < iterations; level++) {
+            simd::vfloat period = simd::set(cell);
+            simd::vfloat3 folded = { fold(local.x, period, half), fold(local.y, period, half), fold(local.z, period, half) };
+            simd::vfloat3 holes = simd::sub(simd::abs(folded), simd::set(cell / 6, cell / 6, cell / 6));
+            simd::vfloat dmin = simd::min(simd::min(holes.x, holes.y), holes.z);
+            simd::vfloat dmax = simd::max(simd::max(holes.x, holes.y), holes.z);
+            simd::vfloat sum = simd::add(simd::add(holes.x, holes.y), holes.z);
+            distance = simd::max(distance, simd::sub(simd::add(dmin, dmax), sum));
+            cell /= 3;
+        }
+        return distance;
+    }
+
+    static inline simd::vfloat3 repeat(const simd::vfloat3 &position, const Instruction &ins) {
+        simd::vfloat3 center = broadcast(ins.position);
+        simd::vfloat local[3] = { simd::sub(position.x, center.x), simd::sub(position.y, center.y), simd::sub(position.z, center.z) };
+        for (int axis = 0; axis < 3; axis++) {
+            float period = ins.size[axis];
+            if (period == 0.0f) continue;
+
+            float count = ins.count[axis];
+            float half = count > 0.0f ? (count - 1) / 2 : 0.0f;
+            simd::vfloat cell = simd::floor(simd::add(simd::div(local[axis], simd::set(period)), simd::set(half + 0.5f)));
+            if (count > 0.0f) cell = simd::min(simd::max(cell, simd::set(0.0f)), simd::set(count - 1));
+            local[axis] = simd::sub(local[axis], simd::mul(simd::set(period), simd::sub(cell, simd::set(half))));
+        }
+        simd::vfloat3 moved = { local[0], local[1], local[2] };
+        return simd::add(moved, center);
+    }
+
+    static inline simd::vfloat3 mirror(const simd::vfloat3 &position, const Instruction &ins) {
+        simd::vfloat3 normal = broadcast(ins.size);
+        simd::vfloat height = simd::dot(simd::sub(position, broadcast(ins.position)), normal);
+        simd::vfloat offset = simd::mul(simd::set(2.0f), simd::min(height, simd::set(0.0f)));
+        return simd::sub(position, simd::mul(normal, offset));
+    }
+
+    template <Op O>
+    static inline simd::vfloat distance(const Instruction &ins, const simd::vfloat3 &position) {
+        switch (O) {
+            case Op::SPHERE:    return sphere(position, ins.position, ins.size.x);
+            case Op::BOX:       return box(position, ins.position, ins.size);
+            case Op::CROSS:     return cross(position, ins.position, ins.size);
+            case Op::MENGER:    return menger(position, ins.position, ins.size.x, ins.size.y);
+            default: break;
+        }
+        return simd::set(std::numeric_limits<float>::infinity());
+    }
+
+    /// Packet gradients ///
+    static inline simd::vmask equal(simd::vfloat a, simd::vfloat b) {
+        return simd::both(simd::invert(simd::lt(a, b)), simd::invert(simd::gt(a, b)));
+    }
+
+    // Unit vectors along the axis holding the deciding component, earlier axes win ties
+    static inline simd::vfloat3 facing(const simd::vfloat3 &local, const simd::vfloat3 &components, simd::vfloat decider) {
+        simd::vmask mx = equal(components.x, decider);
+        simd::vmask my = simd::both(simd::invert(mx), equal(components.y, decider));
+        simd::vmask mz = simd::both(simd::invert(mx), simd::invert(my));
+
+        simd::vfloat zero = simd::set(0.0f), one = simd::set(1.0f), minus = simd::set(-1.0f);
+        return {
+            simd::select(mx, simd::select(simd::lt(local.x, zero), minus, one), zero),
+            simd::select(my, simd::select(simd::lt(local.y, zero), minus, one), zero),
+            simd::select(mz, simd::select(simd::lt(local.z, zero), minus, one), zero)
+        };
+    }
+
+    static inline simd::vfloat median(const simd::vfloat3 &vector) {
+        simd::vfloat lower = simd::min(vector.x, vector.y);
+        simd::vfloat upper = simd::max(vector.x, vector.y);
+        return simd::max(lower, simd::min(upper, vector.z));
+    }
+
+    static inline simd::vfloat sphere(const simd::vfloat3 &position, float3 center, float radius, simd::vfloat3 &grad) {
+        simd::vfloat3 offset = simd::sub(position, broadcast(center));
+        simd::vfloat distance = simd::length(offset);
+        simd::vmask inside = simd::invert(simd::gt(distance, simd::set(0.0f)));
+        grad = simd::select(inside, simd::set(0.0f, 1.0f, 0.0f), simd::mul(offset, simd::div(simd::set(1.0f), distance)));
+        return simd::sub(distance, simd::set(radius));
+    }
+
+    static inline simd::vfloat box(const simd::vfloat3 &position, float3 center, float3 size, simd::vfloat3 &grad) {
+        simd::vfloat3 local = simd::sub(position, broadcast(center));
+        simd::vfloat3 distances = simd::sub(simd::abs(local), broadcast(size));
+        simd::vfloat distance = simd::max(simd::max(distances.x, distances.y), distances.z);
+        grad = facing(local, distances, distance);
+        return distance;
+    }
+
+    static inline simd::vfloat cross(const simd::vfloat3 &position, float3 center, float3 size, simd::vfloat3 &grad) {
+        simd::vfloat3 local = simd::sub(position, broadcast(center));
+        simd::vfloat3 distances = simd::sub(simd::abs(local), broadcast(size));
+        grad = facing(local, distances, median(distances));
+        simd::vfloat dmin = simd::min(simd::min(distances.x, distances.y), distances.z);
+        simd::vfloat dmax = simd::max(simd::max(distances.x, distances.y), distances.z);
+        simd::vfloat sum = simd::add(simd::add(distances.x, distances.y), distances.z);
+        return simd::sub(simd::sub(sum, dmin), dmax);
+    }
+
+    static inline simd::vfloat menger(const simd::vfloat3 &position, float3 center, float size, int iterations, simd::vfloat3 &grad) {
+        simd::vfloat3 local = simd::sub(position, broadcast(center));
+        simd::vfloat3 distances = simd::sub(simd::abs(local), simd::set(size / 2, size / 2, size / 2));
+        simd::vfloat distance = simd::max(simd::max(distances.x, distances.y), distances.z);
+        grad = facing(local, distances, distance);
+
+        simd::vfloat half = simd::set(0.5f);
+        float cell = size;
+        for (int level = 0; level < iterations; level++) {
+            simd::vfloat period = simd::set(cell);
+            simd::vfloat3 folded = { fold(local.x, period, half), fold(local.y, period, half), fold(local.z, period, half) };
+            simd::vfloat3 holes = simd::sub(simd::abs(folded), simd::set(cell / 6, cell / 6, cell / 6));
+            simd::vfloat dmin = simd::min(simd::min(holes.x, holes.y), holes.z);
+            simd::vfloat dmax = simd::max(simd::max(holes.x, holes.y), holes.z);
+            simd::vfloat sum = simd::add(simd::add(holes.x, holes.y), holes.z);
+            simd::vfloat cross = simd::sub(simd::add(dmin, dmax), sum);
+
+            simd::vmask deciding = simd::gt(cross, distance);
+            grad = simd::select(deciding, simd::neg(facing(folded, holes, median(holes))), grad);
+            distance = simd::max(distance, cross);
+            cell /= 3;
+        }
+        return distance;
+    }
+
+    template <Op O>
+    static inline simd::vfloat gradient(const Instruction &ins, const simd::vfloat3 &position, simd::vfloat3 &grad) {
+        switch (O) {
+            case Op::SPHERE:    return sphere(position, ins.position, ins.size.x, grad);
+            case Op::BOX:       return box(position, ins.position, ins.size, grad);
+            case Op::CROSS:     return cross(position, ins.position, ins.size, grad);
+            case Op::MENGER:    return menger(position, ins.position, ins.size.x, ins.size.y, grad);
+            default: break;
+        }
+        grad = simd::set(0.0f, 0.0f, 0.0f);
+        return simd::set(std::numeric_limits<float>::infinity());
+    }
+
+    // Pooled bodies are broadcast one by one, winner indices are only tracked when asked for
+    template <bool track>
+    static simd::vfloat pool(const Body::Pool &pool, const simd::vfloat3 &position, bool maximum, simd::vfloat &index) {
+        float initial = std::numeric_limits<float>::infinity();
+        if (maximum) initial = -initial;
+
+        simd::vfloat best = simd::set(initial);
+        index = simd::set(0.0f);
+        for (size_t idx = 0; idx < pool.count; idx++) {
+            simd::vfloat distance;
+            switch (pool.type) {
+                case Body::Type::SPHERE:
+                    distance = sphere(position, float3(pool.x[idx], pool.y[idx], pool.z[idx]), pool.radius[idx]); break;
+                case Body::Type::BOX:
+                    distance = box(position, float3(pool.x[idx], pool.y[idx], pool.z[idx]),
+                        float3(pool.sx[idx], pool.sy[idx], pool.sz[idx])); break;
+                case Body::Type::CROSS:
+                    distance = cross(position, float3(pool.x[idx], pool.y[idx], pool.z[idx]),
+                        float3(pool.sx[idx], pool.sy[idx], pool.sz[idx])); break;
+                default:
+                    distance = simd::set(std::numeric_limits<float>::infinity()); break;
+            }
+
+            if (track) {
+                simd::vmask better = maximum ? simd::gt(distance, best) : simd::lt(distance, best);
+                index = simd::select(better, simd::set(idx), index);
+            }
+            best = maximum ? simd::max(distance, best) : simd::min(distance, best);
+        }
+        return best;
+    }
+
+    /// Packet values ///
+    struct Distances {
+        simd::vfloat SD;
+    };
+
+    // Materials are exact float indices so they blend like distances
+    struct Hits {
+        simd::vfloat SD;
+        simd::vfloat material;
+    };
+
+    static inline void set(Distances &value, simd::vfloat SD, uint material) {
+        value.SD = SD;
+    }
+
+    static inline void set(Hits &value, simd::vfloat SD, uint material) {
+        value.SD = SD;
+        value.material = simd::set(material);
+    }
+
+    static inline void set(Duals &value, simd::vfloat SD, uint material) {
+        value.SD = SD;
+        value.grad = simd::set(0.0f, 0.0f, 0.0f);
+    }
+
+    template <Op O>
+    static inline void primitive(Distances &value, const Instruction &ins, const simd::vfloat3 &position) {
+        value.SD = distance<O>(ins, position);
+    }
+
+    template <Op O>
+    static inline void primitive(Hits &value, const Instruction &ins, const simd::vfloat3 &position) {
+        value.SD = distance<O>(ins, position);
+        value.material = simd::set(ins.material);
+    }
+
+    template <Op O>
+    static inline void primitive(Duals &value, const Instruction &ins, const simd::vfloat3 &position) {
+        value.SD = gradient<O>(ins, position, value.grad);
+    }
+
+    static inline void negate(Distances &value) {
+        value.SD = simd::neg(value.SD);
+    }
+
+    static inline void negate(Hits &value) {
+        value.SD = simd::neg(value.SD);
+    }
+
+    static inline void negate(Duals &value) {
+        value.SD = simd::neg(value.SD);
+        value.grad = simd::neg(value.grad);
+    }
+
+    static inline void reduce(Distances &value, const Body::Pool &pool, const simd::vfloat3 &position, bool maximum, uint material) {
+        simd::vfloat index;
+        value.SD = Tape::pool<false>(pool, position, maximum, index);
+    }
+
+    static inline void reduce(Hits &value, const Body::Pool &pool, const simd::vfloat3 &position, bool maximum, uint material) {
+        simd::vfloat index;
+        value.SD = Tape::pool<true>(pool, position, maximum, index);
+        value.material = simd::add(index, simd::set(material));
+    }
+
+    static inline void blend(simd::vmask mask, Distances &target, const Distances &value) {
+        target.SD = simd::select(mask, value.SD, target.SD);
+    }
+
+    static inline void blend(simd::vmask mask, Hits &target, const Hits &value) {
+        target.SD = simd::select(mask, value.SD, target.SD);
+        target.material = simd::select(mask, value.material, target.material);
+    }
+
+    static inline void blend(simd::vmask mask, Duals &target, const Duals &value) {
+        target.SD = simd::select(mask, value.SD, target.SD);
+        target.grad = simd::select(mask, value.grad, target.grad);
+    }
+
+    // Gradients of the winning pooled bodies are taken lane by lane
+    static inline void reduce(Duals &value, const Body::Pool &pool, const simd::vfloat3 &position, bool maximum, uint material) {
+        simd::vfloat index;
+        value.SD = Tape::pool<true>(pool, position, maximum, index);
+
+        float infinity = std::numeric_limits<float>::infinity();
+        float indices[simd::lanes], x[simd::lanes], y[simd::lanes], z[simd::lanes];
+        simd::store(indices, index);
+        simd::store(x, position.x);
+        simd::store(y, position.y);
+        simd::store(z, position.z);
+        for (int lane = 0; lane < simd::lanes; lane++) {
+            Dual dual;
+            reduce(dual, pool, float3(x[lane], y[lane], z[lane]), maximum, maximum ? infinity : -infinity, material);
+            x[lane] = dual.grad.x;
+            y[lane] = dual.grad.y;
+            z[lane] = dual.grad.z;
+        }
+        value.grad = { simd::load(x), simd::load(y), simd::load(z) };
+    }
+
+    static inline void leave(Distances &value, const Instruction &enter, const simd::vfloat3 &position) {}
+
+    static inline void leave(Hits &value, const Instruction &enter, const simd::vfloat3 &position) {}
+
+    static inline void leave(Duals &value, const Instruction &enter, const simd::vfloat3 &position) {
+        if (enter.op != Op::MIRROR) return;
+        simd::vfloat3 normal = broadcast(enter.size);
+        simd::vfloat height = simd::dot(simd::sub(position, broadcast(enter.position)), normal);
+        simd::vfloat offset = simd::mul(simd::set(2.0f), simd::dot(value.grad, normal));
+        simd::vfloat3 reflected = simd::sub(value.grad, simd::mul(normal, offset));
+        value.grad = simd::select(simd::lt(height, simd::set(0.0f)), reflected, value.grad);
+    }
+
+    template <typename V>
+    static inline void applyLanes(V *stack, int &top, Fold fold, V value) {
+        switch (fold) {
+            case Fold::PUSH:
+            {
+                stack[++top] = value;
+                break;
+            }
+
+            case Fold::UNION:
+            {
+                blend(simd::lt(value.SD, stack[top].SD), stack[top], value);
+                break;
+            }
+
+            case Fold::COMPLEMENT:
+            {
+                negate(value);
+                blend(simd::lt(value.SD, stack[top].SD), stack[top], value);
+                break;
+            }
+
+            case Fold::INTERSECTION:
+            {
+                blend(simd::gt(value.SD, stack[top].SD), stack[top], value);
+                break;
+            }
+
+            case Fold::DIFFERENCE:
+            {
+                negate(value);
+                blend(simd::gt(value.SD, stack[top].SD), stack[top], value);
+                break;
+            }
+        }
+    }
+
+    template <typename V>
+    static V evaluate(const Program &program, const simd::vfloat3 &point) {
+        V stack[constants::tape::stackMax];
+        simd::vfloat limits[constants::tape::stackMax];
+        int top = -1;
+        limits[0] = simd::set(std::numeric_limits<float>::infinity());
+
+        simd::vfloat3 frames[constants::tape::stackMax];
+        const Instruction *entered[constants::tape::stackMax];
+        int frame = -1;
+        simd::vfloat3 position = point;
+
+        const Instruction *ins = program.code.data();
+        const Instruction *end = ins + program.code.size();
+        for (; ins < end; ins++) {
+            V value;
+            switch (ins->op) {
+                case Op::SPHERE:
+                    primitive<Op::SPHERE>(value, *ins, position); break;
+                case Op::BOX:
+                    primitive<Op::BOX>(value, *ins, position); break;
+                case Op::CROSS:
+                    primitive<Op::CROSS>(value, *ins, position); break;
+                case Op::MENGER:
+                    primitive<Op::MENGER>(value, *ins, position); break;
+                case Op::EMPTY:
+                    set(value, simd::set(std::numeric_limits<float>::infinity()), ins->material); break;
+                case Op::NEGATE:
+                    negate(stack[top]); continue;
+                case Op::MERGE:
+                    value = stack[top--]; break;
+                case Op::POOL:
+                {
+                    bool maximum = ins->fold == Fold::INTERSECTION || ins->fold == Fold::COMPLEMENT;
+                    reduce(value, *ins->pool, position, maximum, ins->material);
+                    break;
+                }
+                case Op::BOUND:
+                {
+                    // Skip only when no lane needs the list
+                    simd::vfloat3 distances = {
+                        simd::max(simd::sub(simd::set(ins->position.x), position.x), simd::sub(position.x, simd::set(ins->size.x))),
+                        simd::max(simd::sub(simd::set(ins->position.y), position.y), simd::sub(position.y, simd::set(ins->size.y))),
+                        simd::max(simd::sub(simd::set(ins->position.z), position.z), simd::sub(position.z, simd::set(ins->size.z)))
+                    };
+                    simd::vfloat distance = simd::max(simd::max(distances.x, distances.y), distances.z);
+                    simd::vfloat limit = ins->fold == Fold::UNION ? stack[top].SD : simd::neg(stack[top].SD);
+                    if (!simd::any(simd::lt(distance, limit))) ins += ins->skip;
+                    continue;
+                }
+                case Op::LIMIT:
+                {
+                    simd::vfloat infinity = simd::set(std::numeric_limits<float>::infinity());
+                    switch (ins->fold) {
+                        case Fold::UNION:
+                            limits[top + 1] = simd::min(stack[top].SD, limits[top]); break;
+                        case Fold::INTERSECTION:
+                            limits[top + 1] = limits[top]; break;
+                        case Fold::DIFFERENCE:
+                            limits[top + 1] = simd::neg(stack[top].SD); break;
+                        default:
+                            limits[top + 1] = infinity; break;
+                    }
+                    continue;
+                }
+                case Op::EXIT:
+                {
+                    // Exit only when every lane reached the limit
+                    if (simd::any(simd::lt(stack[top].SD, limits[top]))) continue;
+                    stats::add(stats::EXITS);
+                    stats::add(stats::SKIPPED, ins->count.x);
+                    ins += ins->skip;
+                    continue;
+                }
+                case Op::REPEAT:
+                    entered[++frame] = ins; frames[frame] = position; position = repeat(position, *ins); continue;
+                case Op::MIRROR:
+                    entered[++frame] = ins; frames[frame] = position; position = mirror(position, *ins); continue;
+                case Op::LEAVE:
+                    leave(stack[top], *entered[frame], frames[frame]); position = frames[frame--]; continue;
+            }
+            applyLanes(stack, top, ins->fold, value);
+        }
+
+        return stack[0];
+    }
+
+    // Colors are gathered for the winning materials only
+    Packet Program::SDF(const simd::vfloat3 &position) const {
+        if (this->tree) {
+            float SD[simd::lanes], r[simd::lanes], g[simd::lanes], b[simd::lanes];
+            for (int idx = 0; idx < simd::lanes; idx++) {
+                Body::Surface surface = this->tree->SDF(lane(position, idx));
+                SD[idx] = surface.SD;
+                r[idx] = surface.color.x;
+                g[idx] = surface.color.y;
+                b[idx] = surface.color.z;
+            }
+            return { .SD = simd::load(SD), .color = { simd::load(r), simd::load(g), simd::load(b) } };
+        }
+
+        Hits hits = evaluate<Hits>(*this, position);
+
+        float materials[simd::lanes], r[simd::lanes], g[simd::lanes], b[simd::lanes];
+        simd::store(materials, hits.material);
+        for (int lane = 0; lane < simd::lanes; lane++) {
+            float3 color = this->materials[static_cast<size_t>(materials[lane])];
+            r[lane] = color.x;
+            g[lane] = color.y;
+            b[lane] = color.z;
+        }
+
+        return { .SD = hits.SD, .color = { simd::load(r), simd::load(g), simd::load(b) } };
+    }
+
+    simd::vfloat Program::distance(const simd::vfloat3 &position) const {
+        if (this->tree) return this->SDF(position).SD;
+        return evaluate<Distances>(*this, position).SD;
+    }
+
+    Duals Program::gradient(const simd::vfloat3 &position) const {
+        if (this->tree) {
+            float SD[simd::lanes], x[simd::lanes], y[simd::lanes], z[simd::lanes];
+            for (int idx = 0; idx < simd::lanes; idx++) {
+                Dual dual = treeGradient(this->tree, lane(position, idx));
+                SD[idx] = dual.SD;
+                x[idx] = dual.grad.x;
+                y[idx] = dual.grad.y;
+                z[idx] = dual.grad.z;
+            }
+            return { .SD = simd::load(SD), .grad = { simd::load(x), simd::load(y), simd::load(z) } };
+        }
+        return evaluate<Duals>(*this, position);
+    }
+}